@@ -0,0 +1,43 @@
+import argparse
+import time
+import cv2
+import mrzscanner
+
+
+def benchmark(name, func, count):
+    start = time.perf_counter()
+    func()
+    elapsed = time.perf_counter() - start
+    print('%-12s %8.1f ms total %8.2f ms/image' %
+          (name, elapsed * 1000, elapsed * 1000 / count))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(
+        description='Compare a decodeMat() loop with decodeBatch()')
+    parser.add_argument('filename')
+    parser.add_argument('-n', '--count', default=64, type=int,
+                        help='Number of images in the batch')
+    parser.add_argument('-t', '--threads', default=0, type=int,
+                        help='Native threads used by decodeBatch(), 0 for one per CPU core')
+    parser.add_argument('-l', '--license', default='', type=str,
+                        help='Set a valid license key')
+    args = parser.parse_args()
+
+    mrzscanner.initLicense(args.license if args.license else
+                           "DLS2eyJoYW5kc2hha2VDb2RlIjoiMjAwMDAxLTE2NDk4Mjk3OTI2MzUiLCJvcmdhbml6YXRpb25JRCI6IjIwMDAwMSIsInNlc3Npb25QYXNzd29yZCI6IndTcGR6Vm05WDJrcEQ5YUoifQ==")
+
+    scanner = mrzscanner.createInstance()
+    scanner.loadModel(mrzscanner.load_settings())
+
+    image = cv2.imread(args.filename)
+    images = [image.copy() for i in range(args.count)]
+
+    # Warm up both paths so recognizer creation is not measured
+    scanner.decodeMat(image)
+    scanner.decodeBatch(images[:1], args.threads)
+
+    benchmark('decodeMat', lambda: [
+              scanner.decodeMat(image) for image in images], args.count)
+    benchmark('decodeBatch', lambda: scanner.decodeBatch(
+        images, args.threads), args.count)
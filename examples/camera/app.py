@@ -3,54 +3,17 @@ import mrzscanner
 import sys
 import numpy as np
 
-from mrz.checker.td1 import TD1CodeChecker
-from mrz.checker.td2 import TD2CodeChecker
-from mrz.checker.td3 import TD3CodeChecker
-from mrz.checker.mrva import MRVACodeChecker
-from mrz.checker.mrvb import MRVBCodeChecker
-
 from multiprocessing.pool import ThreadPool
 from collections import deque
 
 import cv2
 
 def check(lines):
-    try:
-        td1_check = TD1CodeChecker(lines)
-        if bool(td1_check):
-            return "TD1", td1_check.fields()
-    except Exception as err:
-        pass
-    
-    try:
-        td2_check = TD2CodeChecker(lines)
-        if bool(td2_check):
-            return "TD2", td2_check.fields()
-    except Exception as err:
-        pass
-    
-    try:
-        td3_check = TD3CodeChecker(lines)
-        if bool(td3_check):
-            return "TD3", td3_check.fields()
-    except Exception as err:
-        pass
-    
-    try:
-        mrva_check = MRVACodeChecker(lines)
-        if bool(mrva_check):
-            return "MRVA", mrva_check.fields()
-    except Exception as err:
-        pass
-    
-    try:
-        mrvb_check = MRVBCodeChecker(lines)
-        if bool(mrvb_check):
-            return "MRVB", mrvb_check.fields()
-    except Exception as err:
-        pass
-    
-    return 'No valid MRZ information found'
+    document = mrzscanner.parse(lines)
+    if document is None or not document['valid']:
+        return 'No valid MRZ information found'
+
+    return document['type'], document
 
 def process_frame(frame):
     results = None
@@ -133,7 +133,7 @@ setup(name='mrz-scanner-sdk',
           "Topic :: Scientific/Engineering",
           "Topic :: Software Development",
       ],
-      install_requires=['opencv-python', 'mrz'],
+      install_requires=['opencv-python'],
       entry_points={
           'console_scripts': ['scanmrz=mrzscanner.scripts:scanmrz']
       },
@@ -5,11 +5,21 @@
 #include <structmember.h>
 #include "DynamsoftLabelRecognizer.h"
 #include "mrz_result.h"
+#include "recognition.h"
+#include "work_stealing_pool.h"
+#include "frame_pool.h"
+#include "future_utils.h"
+#include "image_processing.h"
+#include "mrz_consensus.h"
 #include <thread>
 #include <condition_variable>
 #include <mutex>
 #include <queue>
 #include <functional>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
 
 #if !defined(_WIN32) && !defined(_WIN64)
 #include <sys/time.h>
@@ -33,6 +43,107 @@ class Task
 public:
     std::function<void()> func;
     unsigned char *buffer;
+    size_t length;
+    PyObject *owner; // zero-copy mode: keeps the caller's image pinned
+    PyObject *future;
+};
+
+// Camera frame layouts accepted by decodeYUV().
+enum YUVFormat
+{
+    YUV_NV21, // Y plane, then interleaved VU
+    YUV_NV12, // Y plane, then interleaved UV
+    YUV_I420, // Y, U and V planes
+    YUV_YUYV  // packed Y0 U Y1 V
+};
+
+// What decodeMatAsync() does when the async queue is full.
+enum QueuePolicy
+{
+    QUEUE_DROP_OLDEST, // discard the oldest queued frame
+    QUEUE_DROP_NEWEST, // discard the incoming frame
+    QUEUE_BLOCK,       // wait for a free slot, up to the timeout
+    QUEUE_REJECT       // raise an error
+};
+
+class AsyncQueue
+{
+public:
+    size_t capacity = 1;
+    int policy = QUEUE_DROP_OLDEST;
+    int timeout = 0; // milliseconds, 0 waits forever
+
+    std::atomic<size_t> processed;
+    std::atomic<size_t> droppedOldest;
+    std::atomic<size_t> droppedNewest;
+    std::atomic<size_t> timedOut;
+    std::atomic<size_t> rejected;
+    std::atomic<size_t> blurry; // frames skipped by the quality gate
+
+    AsyncQueue() : processed(0), droppedOldest(0), droppedNewest(0), timedOut(0), rejected(0), blurry(0) {}
+};
+
+// Reduction applied to decodeMatAsync() frames while they are copied out of the caller's image.
+class IngestTransform
+{
+public:
+    int factor = 1;    // downscale factor, 1 keeps the resolution
+    bool crop = false; // queue only the region of interest
+    int roi[4];        // x, y, width, height
+};
+
+/**
+ * Recognizes a static scene once: a decodeMatAsync() frame whose thumbnail
+ * hardly differs from the last recognized frame gets that frame's results.
+ */
+class FrameDeduplicator
+{
+public:
+    std::mutex m;
+    double threshold = 0; // mean thumbnail difference below which frames are duplicates, 0 disables
+    bool valid = false;   // thumbnail holds the last recognized frame
+    unsigned char thumbnail[THUMBNAIL_SIZE * THUMBNAIL_SIZE];
+    int width = 0;
+    int height = 0;
+    PyObject *results = NULL; // results of the last recognized frame, requires the GIL
+
+    std::atomic<size_t> duplicates;
+
+    FrameDeduplicator() : duplicates(0) {}
+
+    /**
+     * Whether a frame shows the same scene as the last recognized one.
+     *
+     * @param current receives the thumbnail of the frame, for update()
+     * @param enabled set to whether deduplication is on and current was filled
+     */
+    bool isDuplicate(const ImageData *data, unsigned char *current, bool &enabled)
+    {
+        std::lock_guard<std::mutex> lk(m);
+        enabled = threshold > 0;
+        if (!enabled)
+            return false;
+
+        int channels, itemSize;
+        getPixelLayout(data->format, &channels, &itemSize);
+        computeThumbnail(data->bytes, data->width, data->height, data->stride, channels, itemSize, current);
+
+        return valid && width == data->width && height == data->height && thumbnailDifference(current, thumbnail) < threshold;
+    }
+
+    /**
+     * Make a recognized frame the reference for the next ones. Frames skipped
+     * before recognition never become the reference, since their results are
+     * not the ones cached.
+     */
+    void update(const unsigned char *current, int frameWidth, int frameHeight)
+    {
+        std::lock_guard<std::mutex> lk(m);
+        memcpy(thumbnail, current, sizeof(thumbnail));
+        width = frameWidth;
+        height = frameHeight;
+        valid = true;
+    }
 };
 
 class WorkerThread
@@ -40,9 +151,14 @@ class WorkerThread
 public:
     std::mutex m;
     std::condition_variable cv;
+    std::condition_variable notFull;
+    int waiting = 0; // producers blocked on notFull
     std::queue<Task> tasks = {};
     std::atomic<bool> running;
     std::thread t;
+    // The worker recognizes with its own handle, so decodeMat() never waits for it.
+    void *handler;
+    std::mutex handlerLock;
 };
 
 typedef struct
@@ -50,17 +166,57 @@ typedef struct
     PyObject_HEAD void *handler;
     PyObject *callback;
     WorkerThread *worker;
+    std::mutex *handlerLock;             // serializes decodeMat()/decodeFile() calls on handler
+    std::vector<std::string> *settings; // loaded models, replayed onto the worker handle
+    AsyncQueue *queue;
+    FramePool *framePool;
+    WorkStealingPool *batchPool; // recognizers used by decodeBatch(), created on first use
+    int batchesRunning;          // decodeBatch() calls using batchPool, requires the GIL
+    MrzConsensus *consensus;     // votes across decodeMatAsync() frames
+    PipelineSettings *pipeline;
+    RoiTracker *tracker; // follows the MRZ across decodeMatAsync() frames
+    FrameDeduplicator *deduplicator;
+    IngestTransform *ingest;
 } DynamsoftMrzReader;
 
-void clearTasks(DynamsoftMrzReader *self)
+/**
+ * Give back the buffer of a frame that will not be scanned. Requires the GIL.
+ */
+void releaseFrame(DynamsoftMrzReader *self, Task &task)
+{
+    cancelFuture(task.future);
+    Py_DECREF(task.future);
+
+    if (task.owner)
+        Py_DECREF(task.owner);
+    else
+        self->framePool->release(task.buffer, task.length);
+}
+
+/**
+ * Move the queued tasks out of the queue. Requires worker->m.
+ */
+void takeTasks(DynamsoftMrzReader *self, std::vector<Task> &tasks)
 {
     while (!self->worker->tasks.empty())
     {
-        free(self->worker->tasks.front().buffer);
+        tasks.push_back(self->worker->tasks.front());
         self->worker->tasks.pop();
     }
 }
 
+/**
+ * Release frames taken out of the queue. Must not be called with worker->m
+ * held: cancelling a concurrent.futures.Future runs its done-callbacks, which
+ * may call back into the scanner.
+ */
+void releaseFrames(DynamsoftMrzReader *self, std::vector<Task> &tasks)
+{
+    for (size_t i = 0; i < tasks.size(); i++)
+        releaseFrame(self, tasks[i]);
+    tasks.clear();
+}
+
 void clear(DynamsoftMrzReader *self)
 {
     if (self->callback)
@@ -71,13 +227,25 @@ void clear(DynamsoftMrzReader *self)
 
     if (self->worker)
     {
+        std::vector<Task> cleared;
         std::unique_lock<std::mutex> lk(self->worker->m);
         self->worker->running = false;
-        clearTasks(self);
+        takeTasks(self, cleared);
         self->worker->cv.notify_one();
+
+        // Let producers blocked on a full queue leave before the worker is deleted.
+        self->worker->notFull.notify_all();
+        self->worker->notFull.wait(lk, [&]
+                                   { return self->worker->waiting == 0; });
         lk.unlock();
+        releaseFrames(self, cleared);
 
+        // The worker needs the GIL to deliver results, so it must not be held while joining.
+        Py_BEGIN_ALLOW_THREADS
         self->worker->t.join();
+        Py_END_ALLOW_THREADS
+
+        DLR_DestroyInstance(self->worker->handler);
         delete self->worker;
         self->worker = NULL;
         printf("Quit native thread.\n");
@@ -93,6 +261,33 @@ static int DynamsoftMrzReader_clear(DynamsoftMrzReader *self)
         self->handler = NULL;
     }
 
+    delete self->handlerLock;
+    self->handlerLock = NULL;
+    delete self->settings;
+    self->settings = NULL;
+    delete self->queue;
+    self->queue = NULL;
+    delete self->framePool;
+    self->framePool = NULL;
+    delete self->consensus;
+    self->consensus = NULL;
+    delete self->pipeline;
+    self->pipeline = NULL;
+    delete self->tracker;
+    self->tracker = NULL;
+    if (self->deduplicator)
+        Py_XDECREF(self->deduplicator->results);
+    delete self->deduplicator;
+    self->deduplicator = NULL;
+    delete self->ingest;
+    self->ingest = NULL;
+
+    if (self->batchPool)
+    {
+        destroyWorkStealingPool(self->batchPool);
+        self->batchPool = NULL;
+    }
+
     return 0;
 }
 
@@ -112,94 +307,114 @@ static PyObject *DynamsoftMrzReader_new(PyTypeObject *type, PyObject *args, PyOb
         self->handler = DLR_CreateInstance();
         self->worker = NULL;
         self->callback = NULL;
+        self->handlerLock = new std::mutex();
+        self->settings = new std::vector<std::string>();
+        self->queue = new AsyncQueue();
+        self->framePool = new FramePool();
+        self->batchPool = NULL;
+        self->batchesRunning = 0;
+        self->consensus = new MrzConsensus();
+        self->pipeline = new PipelineSettings();
+        self->tracker = new RoiTracker();
+        self->deduplicator = new FrameDeduplicator();
+        self->ingest = new IngestTransform();
     }
 
     return (PyObject *)self;
 }
 
-PyObject *createPyList(DLR_ResultArray *pResults)
+/**
+ * Recognize an image on the reader's handle with the GIL released. The caller
+ * keeps the image bytes alive.
+ *
+ * @param int format: RESULT_OBJECTS, RESULT_ARRAYS or RESULT_CHARACTERS
+ *
+ * @return MrzResult list, or a dict of arrays
+ */
+static PyObject *recognizeImage(DynamsoftMrzReader *self, ImageData *data, int format = RESULT_OBJECTS)
 {
-    int count = pResults->resultsCount;
-
-    // Create a Python object to store results
-    PyObject *list = PyList_New(0);
-    for (int i = 0; i < count; i++)
+    DLR_ResultArray *pResults = NULL;
+    Py_BEGIN_ALLOW_THREADS
     {
-        DLR_Result *mrzResult = pResults->results[i];
-        int lCount = mrzResult->lineResultsCount;
-        for (int j = 0; j < lCount; j++)
-        {
-            // printf("Line result %d: %s\n", j, mrzResult->lineResults[j]->text);
-
-            DM_Point *points = mrzResult->lineResults[j]->location.points;
-            int x1 = points[0].x;
-            int y1 = points[0].y;
-            int x2 = points[1].x;
-            int y2 = points[1].y;
-            int x3 = points[2].x;
-            int y3 = points[2].y;
-            int x4 = points[3].x;
-            int y4 = points[3].y;
-            MrzResult *result = PyObject_New(MrzResult, &MrzResultType);
-            result->confidence = Py_BuildValue("i", mrzResult->lineResults[j]->confidence);
-            result->text = PyUnicode_FromString(mrzResult->lineResults[j]->text);
-            result->x1 = Py_BuildValue("i", x1);
-            result->y1 = Py_BuildValue("i", y1);
-            result->x2 = Py_BuildValue("i", x2);
-            result->y2 = Py_BuildValue("i", y2);
-            result->x3 = Py_BuildValue("i", x3);
-            result->y3 = Py_BuildValue("i", y3);
-            result->x4 = Py_BuildValue("i", x4);
-            result->y4 = Py_BuildValue("i", y4);
-
-            PyList_Append(list, (PyObject *)result);
-        }
+        std::lock_guard<std::mutex> lk(*self->handlerLock);
+        pResults = recognizeFrame(self->handler, data, self->pipeline);
     }
+    Py_END_ALLOW_THREADS
 
-    return list;
+    return createPyResults(pResults, format);
 }
 
-static PyObject *createPyResults(DynamsoftMrzReader *self)
+/**
+ * Recognize MRZ from image files.
+ *
+ * @param string filename
+ *
+ * @return MrzResult list
+ */
+static PyObject *decodeFile(PyObject *obj, PyObject *args)
 {
-    DLR_ResultArray *pResults = NULL;
-    DLR_GetAllResults(self->handler, &pResults);
-    if (!pResults)
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+
+    char *pFileName; // File name
+    if (!PyArg_ParseTuple(args, "s", &pFileName))
     {
         return NULL;
     }
 
-    PyObject *list = createPyList(pResults);
+    DLR_ResultArray *pResults = NULL;
+    int ret;
 
-    // Release memory
-    DLR_FreeResults(&pResults);
+    Py_BEGIN_ALLOW_THREADS
+    {
+        std::lock_guard<std::mutex> lk(*self->handlerLock);
+        ret = DLR_RecognizeByFile(self->handler, pFileName, "locr");
+        if (ret)
+        {
+            printf("Detection error: %s\n", DLR_GetErrorString(ret));
+        }
+        DLR_GetAllResults(self->handler, &pResults);
+    }
+    Py_END_ALLOW_THREADS
 
+    PyObject *list = createPyResults(pResults);
     return list;
 }
 
 /**
- * Recognize MRZ from image files.
+ * Recognize MRZ from an encoded image (e.g. JPEG or PNG bytes) in memory.
  *
- * @param string filename
+ * @param bytes-like object
  *
  * @return MrzResult list
  */
-static PyObject *decodeFile(PyObject *obj, PyObject *args)
+static PyObject *decodeBytes(PyObject *obj, PyObject *args)
 {
     DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
 
-    char *pFileName; // File name
-    if (!PyArg_ParseTuple(args, "s", &pFileName))
+    Py_buffer view;
+    if (!PyArg_ParseTuple(args, "y*", &view))
     {
         return NULL;
     }
 
-    int ret = DLR_RecognizeByFile(self->handler, pFileName, "locr");
-    if (ret)
+    DLR_ResultArray *pResults = NULL;
+    int ret;
+
+    Py_BEGIN_ALLOW_THREADS
     {
-        printf("Detection error: %s\n", DLR_GetErrorString(ret));
+        std::lock_guard<std::mutex> lk(*self->handlerLock);
+        ret = DLR_RecognizeFileInMemory(self->handler, (const unsigned char *)view.buf, (int)view.len, "locr");
+        if (ret)
+        {
+            printf("Detection error: %s\n", DLR_GetErrorString(ret));
+        }
+        DLR_GetAllResults(self->handler, &pResults);
     }
+    Py_END_ALLOW_THREADS
 
-    PyObject *list = createPyResults(self);
+    PyBuffer_Release(&view);
+
+    PyObject *list = createPyResults(pResults);
     return list;
 }
 
@@ -207,192 +422,351 @@ static PyObject *decodeFile(PyObject *obj, PyObject *args)
  * Recognize MRZ from OpenCV Mat.
  *
  * @param Mat image
+ * @param int format: RESULT_OBJECTS (default), RESULT_ARRAYS or RESULT_CHARACTERS
  *
- * @return MrzResult list
+ * @return MrzResult list, or a dict of numpy arrays for the other formats
  */
 static PyObject *decodeMat(PyObject *obj, PyObject *args)
 {
     DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
 
     PyObject *o;
-    if (!PyArg_ParseTuple(args, "O", &o))
+    int format = RESULT_OBJECTS;
+    if (!PyArg_ParseTuple(args, "O|i", &o, &format))
         return NULL;
 
-    Py_buffer *view;
-    int nd;
-    PyObject *memoryview = PyMemoryView_FromObject(o);
-    if (memoryview == NULL)
-    {
-        PyErr_Clear();
+    ImageData data;
+    PyObject *owner = getImageData(o, &data);
+    if (owner == NULL)
+        return NULL;
+
+    // The owner keeps the buffer pinned while the GIL is released.
+    PyObject *list = recognizeImage(self, &data, format);
+
+    Py_DECREF(owner);
+
+    return list;
+}
+
+/**
+ * Recognize a batch of OpenCV Mats in one call. The batch is spread over
+ * native threads, each with its own recognizer, with the GIL released for the
+ * whole batch.
+ *
+ * @param list of Mat images, or an N x H x W (x C) array
+ * @param int number of threads. The pool is recreated when it changes, which
+ *            raises RuntimeError while another thread is decoding a batch;
+ *            0 (default) keeps the current pool, or uses one thread per CPU
+ *            core the first time.
+ * @param int format: RESULT_OBJECTS (default), RESULT_ARRAYS or RESULT_CHARACTERS
+ *
+ * @return a list holding the results of each image, in input order
+ */
+static PyObject *decodeBatch(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+
+    PyObject *o;
+    int threads = 0;
+    int format = RESULT_OBJECTS;
+    if (!PyArg_ParseTuple(args, "O|ii", &o, &threads, &format))
         return NULL;
+
+    // Iterating an N-dimensional array yields views, so images are not copied.
+    PyObject *seq = PySequence_Fast(o, "argument must be a sequence of images");
+    if (seq == NULL)
+        return NULL;
+
+    if (self->batchPool && threads > 0 && (size_t)threads != self->batchPool->workers.size())
+    {
+        // Other threads may be waiting on the pool with the GIL released.
+        if (self->batchesRunning > 0)
+        {
+            Py_DECREF(seq);
+            PyErr_SetString(PyExc_RuntimeError, "cannot change the thread count while a batch is running");
+            return NULL;
+        }
+        destroyWorkStealingPool(self->batchPool);
+        self->batchPool = NULL;
+    }
+
+    if (self->batchPool == NULL)
+    {
+        self->batchPool = createWorkStealingPool(threads);
+        char errorMsgBuffer[512];
+        for (size_t i = 0; i < self->settings->size(); i++)
+        {
+            self->batchPool->loadSettings((*self->settings)[i].c_str(), errorMsgBuffer, 512);
+        }
     }
 
-    view = PyMemoryView_GET_BUFFER(memoryview);
-    char *buffer = (char *)view->buf;
-    nd = view->ndim;
-    int len = view->len;
-    int stride = view->strides[0];
-    int width = view->strides[0] / view->strides[1];
-    int height = len / stride;
+    self->batchesRunning++;
+    PyObject *list = mapImages(self->batchPool, seq, format);
+    self->batchesRunning--;
+    Py_DECREF(seq);
+    return list;
+}
+
+/**
+ * Recognize MRZ from a YUV camera frame. Only the luma plane is read, as a
+ * grayscale image: planar and semi-planar frames are passed to the SDK without
+ * any conversion, and the luma of packed YUYV frames is extracted in one pass.
+ *
+ * @param buffer frame bytes
+ * @param int width
+ * @param int height
+ * @param int format: YUV_NV21, YUV_NV12, YUV_I420 or YUV_YUYV
+ * @param int stride of the luma plane (or of a YUYV row) in bytes, defaults to the packed stride
+ *
+ * @return MrzResult list
+ */
+static PyObject *decodeYUV(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
 
-    ImagePixelFormat format = IPF_RGB_888;
+    PyObject *o;
+    int width, height, format;
+    int stride = 0;
+    if (!PyArg_ParseTuple(args, "Oiii|i", &o, &width, &height, &format, &stride))
+        return NULL;
 
-    if (width == stride)
+    if (format < YUV_NV21 || format > YUV_YUYV)
     {
-        format = IPF_GRAYSCALED;
+        PyErr_SetString(PyExc_ValueError, "unknown YUV format");
+        return NULL;
     }
-    else if (width * 3 == stride)
+
+    int pixelBytes = format == YUV_YUYV ? 2 : 1;
+    if (stride == 0)
+        stride = width * pixelBytes;
+
+    if (width <= 0 || height <= 0 || stride < width * pixelBytes)
     {
-        format = IPF_RGB_888;
+        PyErr_SetString(PyExc_ValueError, "invalid frame size");
+        return NULL;
     }
-    else if (width * 4 == stride)
+
+    Py_buffer view;
+    if (PyObject_GetBuffer(o, &view, PyBUF_SIMPLE) < 0)
+        return NULL;
+
+    if (view.len < (Py_ssize_t)stride * height)
     {
-        format = IPF_ARGB_8888;
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "buffer is smaller than the frame");
+        return NULL;
     }
 
     ImageData data;
-    data.bytes = (unsigned char *)buffer;
     data.width = width;
     data.height = height;
-    data.stride = stride;
-    data.format = format;
-    data.bytesLength = len;
+    data.format = IPF_GRAYSCALED;
 
-    int ret = DLR_RecognizeByBuffer(self->handler, &data, "locr");
-    if (ret)
+    unsigned char *luma = NULL;
+    if (format == YUV_YUYV)
+    {
+        luma = (unsigned char *)malloc((size_t)width * height);
+        extractLuma(luma, (const unsigned char *)view.buf, stride, width, height);
+        data.bytes = luma;
+        data.stride = width;
+        data.bytesLength = width * height;
+    }
+    else
     {
-        printf("Detection error: %s\n", DLR_GetErrorString(ret));
+        // The Y plane comes first in NV21, NV12 and I420 frames.
+        data.bytes = (unsigned char *)view.buf;
+        data.stride = stride;
+        data.bytesLength = stride * height;
     }
 
-    PyObject *list = createPyResults(self);
+    PyObject *list = recognizeImage(self, &data);
 
-    Py_DECREF(memoryview);
+    free(luma);
+    PyBuffer_Release(&view);
 
     return list;
 }
 
-void onResultReady(DynamsoftMrzReader *self)
+/**
+ * Convert the consensus to a dict, or None if it is not done. Requires the GIL.
+ */
+PyObject *createPyConsensus(DynamsoftMrzReader *self)
 {
-    PyGILState_STATE gstate;
-    gstate = PyGILState_Ensure();
-    PyObject *list = createPyResults(self);
-    PyObject *result = PyObject_CallFunction(self->callback, "O", list);
-    if (result != NULL)
-        Py_DECREF(result);
+    MrzDocument document;
+    {
+        std::lock_guard<std::mutex> lk(self->consensus->m);
+        if (!self->consensus->done)
+            Py_RETURN_NONE;
+        document = self->consensus->document;
+    }
 
-    PyGILState_Release(gstate);
+    return createPyDocument(document);
 }
 
-void scan(DynamsoftMrzReader *self, unsigned char *buffer, int width, int height, int stride, ImagePixelFormat format, int len)
+/**
+ * Deliver the result of a frame. In consensus mode, the listener only gets
+ * the consensus, once it is reached.
+ */
+void onResultReady(DynamsoftMrzReader *self, DLR_ResultArray *pResults, PyObject *owner, PyObject *future, bool consensusReached)
 {
-    ImageData data;
-    data.bytes = buffer;
-    data.width = width;
-    data.height = height;
-    data.stride = stride;
-    data.format = format;
-    data.bytesLength = len;
+    PyGILState_STATE gstate;
+    gstate = PyGILState_Ensure();
+    Py_XDECREF(owner);
 
-    int ret = DLR_RecognizeByBuffer(self->handler, &data, "locr");
-    if (ret)
+    PyObject *list = createPyResults(pResults);
+    if (list == NULL)
+        list = PyList_New(0);
+
+    resolveFuture(future, list);
+    Py_DECREF(future);
+
+    // Kept for the next frames if they show the same scene.
+    if (self->deduplicator->threshold > 0)
     {
-        printf("Detection error: %s\n", DLR_GetErrorString(ret));
+        Py_INCREF(list);
+        Py_XSETREF(self->deduplicator->results, list);
     }
 
-    free(buffer);
-    if (self->callback)
+    PyObject *value = list;
+    if (self->consensus->enabled())
+        value = consensusReached ? createPyConsensus(self) : NULL;
+
+    // The listener may have been cleared while the frame was being recognized.
+    if (self->callback && value)
     {
-        onResultReady(self);
+        PyObject *result = PyObject_CallFunction(self->callback, "O", value);
+        if (result != NULL)
+            Py_DECREF(result);
     }
+    if (value != list)
+        Py_XDECREF(value);
+    Py_DECREF(list);
+
+    PyGILState_Release(gstate);
 }
 
 /**
- * Recognize MRZ from OpenCV Mat asynchronously.
- *
- * @param Mat image
- *
+ * Deliver the results of the last recognized frame for a duplicate frame. In
+ * consensus mode, a duplicate frame does not vote.
  */
-static PyObject *decodeMatAsync(PyObject *obj, PyObject *args)
+void onCachedResult(DynamsoftMrzReader *self, PyObject *owner, PyObject *future)
 {
-    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
-    PyObject *o;
-    if (!PyArg_ParseTuple(args, "O", &o))
-        Py_BuildValue("i", -1);
+    PyGILState_STATE gstate;
+    gstate = PyGILState_Ensure();
+    Py_XDECREF(owner);
+
+    PyObject *cached = self->deduplicator->results;
+    PyObject *list = cached ? PyList_GetSlice(cached, 0, PY_SSIZE_T_MAX) : PyList_New(0);
 
-    Py_buffer *view;
-    int nd;
-    PyObject *memoryview = PyMemoryView_FromObject(o);
-    if (memoryview == NULL)
+    resolveFuture(future, list);
+    Py_DECREF(future);
+
+    if (self->callback && !self->consensus->enabled())
     {
-        PyErr_Clear();
-        Py_BuildValue("i", -1);
+        PyObject *result = PyObject_CallFunction(self->callback, "O", list);
+        if (result != NULL)
+            Py_DECREF(result);
     }
+    Py_DECREF(list);
+
+    PyGILState_Release(gstate);
+}
 
-    view = PyMemoryView_GET_BUFFER(memoryview);
-    char *buffer = (char *)view->buf;
-    nd = view->ndim;
-    int len = view->len;
-    int stride = view->strides[0];
-    int width = view->strides[0] / view->strides[1];
-    int height = len / stride;
+/**
+ * Cancel a frame that does not need to be recognized.
+ */
+void onFrameSkipped(PyObject *owner, PyObject *future)
+{
+    PyGILState_STATE gstate;
+    gstate = PyGILState_Ensure();
+    Py_XDECREF(owner);
+    cancelFuture(future);
+    Py_DECREF(future);
+    PyGILState_Release(gstate);
+}
 
-    ImagePixelFormat format = IPF_RGB_888;
+/**
+ * Recognize a queued frame.
+ *
+ * @param factor, dx, dy the ingest transform of the frame: results are scaled
+ *                       by factor and offset by (dx, dy) to refer to the
+ *                       caller's image
+ */
+void scan(DynamsoftMrzReader *self, unsigned char *buffer, PyObject *owner, PyObject *future, int width, int height, int stride, ImagePixelFormat format, int len,
+          int factor, int dx, int dy)
+{
+    ImageData data;
+    data.bytes = buffer;
+    data.width = width;
+    data.height = height;
+    data.stride = stride;
+    data.format = format;
+    data.bytesLength = len;
 
-    if (width == stride)
+    // Frames queued before the consensus was reached are not recognized.
+    MrzConsensus *consensus = self->consensus;
+    if (consensus->enabled() && consensus->done)
     {
-        format = IPF_GRAYSCALED;
+        if (!owner)
+            self->framePool->release(buffer, len);
+        onFrameSkipped(owner, future);
+        return;
     }
-    else if (width * 3 == stride)
+
+    // A static scene is recognized once.
+    unsigned char thumbnail[THUMBNAIL_SIZE * THUMBNAIL_SIZE];
+    bool deduplicate;
+    if (self->deduplicator->isDuplicate(&data, thumbnail, deduplicate))
     {
-        format = IPF_RGB_888;
+        if (!owner)
+            self->framePool->release(buffer, len);
+        self->deduplicator->duplicates++;
+        onCachedResult(self, owner, future);
+        return;
     }
-    else if (width * 4 == stride)
+
+    // Frames too blurred to be read are skipped before recognition.
+    double minSharpness = self->pipeline->minSharpness;
+    if (minSharpness > 0 && getSharpness(&data) < minSharpness)
     {
-        format = IPF_ARGB_8888;
+        if (!owner)
+            self->framePool->release(buffer, len);
+        self->queue->blurry++;
+        onFrameSkipped(owner, future);
+        return;
     }
 
-    unsigned char *data = (unsigned char *)malloc(len);
-    memcpy(data, buffer, len);
-
-    if (self->worker)
+    DLR_ResultArray *pResults;
     {
-        std::unique_lock<std::mutex> lk(self->worker->m);
-        clearTasks(self);
-        std::function<void()> task_function = std::bind(scan, self, data, width, height, stride, format, len);
-        Task task;
-        task.func = task_function;
-        task.buffer = data;
-        self->worker->tasks.push(task);
-        self->worker->cv.notify_one();
-        lk.unlock();
+        std::lock_guard<std::mutex> lk(self->worker->handlerLock);
+        pResults = recognizeTracked(self->worker->handler, &data, self->pipeline, self->tracker);
     }
 
-    Py_DECREF(memoryview);
-    return Py_BuildValue("i", 0);
-}
+    if (deduplicate)
+        self->deduplicator->update(thumbnail, width, height);
 
-/**
- * Load MRZ configuration file.
- *
- * @param string template content
- *
- * @return loading status
- */
-static PyObject *loadModel(PyObject *obj, PyObject *args)
-{
-    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+    if (!owner)
+        self->framePool->release(buffer, len);
+    self->queue->processed++;
 
-    char *settings; // File name
-    if (!PyArg_ParseTuple(args, "s", &settings))
+    if (pResults)
     {
-        Py_BuildValue("i", -1);
+        if (factor > 1)
+            scaleResults(pResults, factor);
+        if (dx || dy)
+            offsetResults(pResults, dx, dy);
     }
 
-    char errorMsgBuffer[512];
-    int ret = DLR_AppendSettingsFromString(self->handler, settings, errorMsgBuffer, 512);
-    printf("Load MRZ model: %s\n", errorMsgBuffer);
+    bool consensusReached = false;
+    if (consensus->enabled() && pResults)
+    {
+        std::vector<std::string> lines;
+        std::vector<std::vector<MrzCandidates> > candidates;
+        mrzLinesFromResults(pResults, lines, candidates);
+        consensusReached = consensus->add(lines, candidates);
+    }
 
-    return Py_BuildValue("i", ret);
+    onResultReady(self, pResults, owner, future, consensusReached);
 }
 
 void run(DynamsoftMrzReader *self)
@@ -409,6 +783,7 @@ void run(DynamsoftMrzReader *self)
         }
         task = std::move(self->worker->tasks.front().func);
         self->worker->tasks.pop();
+        self->worker->notFull.notify_one();
         lk.unlock();
 
         task();
@@ -416,38 +791,809 @@ void run(DynamsoftMrzReader *self)
 }
 
 /**
- * Register callback function to receive MRZ decoding result asynchronously.
+ * Start the native thread serving decodeMatAsync() if it is not running.
  */
-static PyObject *addAsyncListener(PyObject *obj, PyObject *args)
+WorkerThread *startWorker(DynamsoftMrzReader *self)
 {
-    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
-
-    PyObject *callback = NULL;
-    if (!PyArg_ParseTuple(args, "O", &callback))
-    {
-        Py_BuildValue("i", -1);
-    }
-
-    if (!PyCallable_Check(callback))
-    {
-        PyErr_SetString(PyExc_TypeError, "parameter must be callable");
-        Py_BuildValue("i", -1);
-    }
-    else
-    {
-        Py_XINCREF(callback);       /* Add a reference to new callback */
-        Py_XDECREF(self->callback); /* Dispose of previous callback */
-        self->callback = callback;
-    }
-
     if (self->worker == NULL)
     {
         self->worker = new WorkerThread();
+        self->worker->handler = DLR_CreateInstance();
+        char errorMsgBuffer[512];
+        for (size_t i = 0; i < self->settings->size(); i++)
+        {
+            DLR_AppendSettingsFromString(self->worker->handler, (*self->settings)[i].c_str(), errorMsgBuffer, 512);
+        }
         self->worker->running = true;
         self->worker->t = std::thread(&run, self);
+        printf("Running native thread...\n");
+    }
+
+    return self->worker;
+}
+
+/**
+ * Give up a decodeMatAsync() call whose frame buffer could not be allocated.
+ *
+ * @return NULL, with MemoryError set
+ */
+static PyObject *onFrameAllocationFailed(PyObject *owner, PyObject *future)
+{
+    Py_DECREF(owner);
+    Py_DECREF(future);
+    return PyErr_NoMemory();
+}
+
+/**
+ * Recognize MRZ from OpenCV Mat asynchronously. The result is delivered to the
+ * listener registered with addAsyncListener(), if any, and to the returned future.
+ *
+ * @param Mat image
+ *
+ * @return an asyncio future when called from a running event loop, a
+ *         concurrent.futures.Future otherwise. It is cancelled if the frame is dropped.
+ */
+static PyObject *decodeMatAsync(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+    PyObject *o;
+    if (!PyArg_ParseTuple(args, "O", &o))
+        return NULL;
+
+    // Once the consensus is reached, frames are not copied nor recognized.
+    if (self->consensus->enabled() && self->consensus->done)
+    {
+        PyObject *future = createFuture();
+        if (future)
+            cancelFuture(future);
+        return future;
+    }
+
+    ImageData image;
+    PyObject *owner = getImageData(o, &image);
+    if (owner == NULL)
+        return NULL;
+
+    // Only the region of interest is queued, clipped to the image.
+    IngestTransform *ingest = self->ingest;
+    int dx = 0, dy = 0;
+    if (ingest->crop)
+    {
+        int rect[4];
+        rect[0] = std::min(std::max(ingest->roi[0], 0), image.width - 1);
+        rect[1] = std::min(std::max(ingest->roi[1], 0), image.height - 1);
+        rect[2] = std::max(std::min(ingest->roi[0] + ingest->roi[2], image.width) - rect[0], 1);
+        rect[3] = std::max(std::min(ingest->roi[1] + ingest->roi[3], image.height) - rect[1], 1);
+        image = cropImageData(&image, rect);
+        dx = rect[0];
+        dy = rect[1];
+    }
+    int factor = ingest->factor;
+    if (image.width / factor < PYRAMID_MIN_SIZE || image.height / factor < PYRAMID_MIN_SIZE)
+        factor = 1;
+
+    int width = image.width;
+    int height = image.height;
+    int stride = image.stride;
+    ImagePixelFormat format = image.format;
+    int len = image.bytesLength;
+    int rowBytes = width * getPixelBytes(format);
+
+    PyObject *future = createFuture();
+    if (future == NULL)
+    {
+        Py_DECREF(owner);
+        return NULL;
+    }
+
+    WorkerThread *worker = startWorker(self);
+
+    AsyncQueue *queue = self->queue;
+    Task task;
+    if (self->framePool->zeroCopy)
+    {
+        // Keep the caller's image pinned until the frame has been scanned.
+        task.buffer = image.bytes;
+        task.owner = owner;
+        factor = 1;
+    }
+    else if (factor > 1)
+    {
+        // Downscale while copying, to gray as well if enabled, so the frame is read once.
+        int channels, itemSize;
+        getPixelLayout(format, &channels, &itemSize);
+        bool gray = self->pipeline->grayscale && format != IPF_GRAYSCALED;
+        int pixelBytes = gray ? 1 : getPixelBytes(format);
+        width = image.width / factor;
+        height = image.height / factor;
+        len = width * height * pixelBytes;
+        task.buffer = self->framePool->acquire(len);
+        task.owner = NULL;
+        if (task.buffer == NULL)
+            return onFrameAllocationFailed(owner, future);
+        if (gray)
+            downscaleToGray(image.bytes, image.width, image.height, stride, channels, itemSize, factor, task.buffer);
+        else
+            downscaleImage(image.bytes, image.width, image.height, stride, channels, itemSize, factor, task.buffer);
+        stride = width * pixelBytes;
+        format = gray ? IPF_GRAYSCALED : format;
+        Py_DECREF(owner);
+    }
+    else if (self->pipeline->grayscale && format != IPF_GRAYSCALED)
+    {
+        // Convert while copying, so the frame is read once and the queued copy is gray.
+        int channels, itemSize;
+        getPixelLayout(format, &channels, &itemSize);
+        len = width * height;
+        task.buffer = self->framePool->acquire(len);
+        task.owner = NULL;
+        if (task.buffer == NULL)
+            return onFrameAllocationFailed(owner, future);
+        convertToGray(task.buffer, width, image.bytes, stride, width, height, channels, itemSize);
+        stride = width;
+        format = IPF_GRAYSCALED;
+        Py_DECREF(owner);
+    }
+    else
+    {
+        // Pack the rows of cropped views so no bytes outside the image are copied.
+        len = rowBytes * height;
+        task.buffer = self->framePool->acquire(len);
+        task.owner = NULL;
+        if (task.buffer == NULL)
+            return onFrameAllocationFailed(owner, future);
+        copyRows(task.buffer, rowBytes, image.bytes, stride, rowBytes, height);
+        stride = rowBytes;
+        Py_DECREF(owner);
+    }
+    task.length = len;
+    task.future = future;
+    task.func = std::bind(scan, self, task.buffer, task.owner, task.future, width, height, stride, format, len, factor, dx, dy);
+
+    // The caller's reference is taken before queuing: with QUEUE_BLOCK, the GIL
+    // is released once the task is queued, and the worker may complete it and
+    // drop the task's reference before this call returns.
+    Py_INCREF(future);
+
+    bool queued = true;
+    bool pushed = false;
+    std::vector<Task> dropped; // released once worker->m is unlocked
+    std::unique_lock<std::mutex> lk(worker->m);
+    if (worker->tasks.size() >= queue->capacity)
+    {
+        switch (queue->policy)
+        {
+        case QUEUE_DROP_OLDEST:
+            while (!worker->tasks.empty() && worker->tasks.size() >= queue->capacity)
+            {
+                dropped.push_back(worker->tasks.front());
+                worker->tasks.pop();
+                queue->droppedOldest++;
+            }
+            break;
+        case QUEUE_DROP_NEWEST:
+            queue->droppedNewest++;
+            queued = false;
+            break;
+        case QUEUE_BLOCK:
+            // Wait without the GIL, and queue the task before releasing the lock:
+            // once it is released, clearAsyncListener() may delete the worker.
+            worker->waiting++;
+            Py_BEGIN_ALLOW_THREADS
+            auto hasRoom = [&]
+            { return worker->tasks.size() < queue->capacity || !worker->running; };
+            if (queue->timeout > 0)
+                queued = worker->notFull.wait_for(lk, std::chrono::milliseconds(queue->timeout), hasRoom);
+            else
+                worker->notFull.wait(lk, hasRoom);
+            worker->waiting--;
+
+            if (!worker->running)
+            {
+                queued = false;
+                worker->notFull.notify_all();
+            }
+            else if (!queued)
+            {
+                queue->timedOut++;
+            }
+            else
+            {
+                worker->tasks.push(task);
+                worker->cv.notify_one();
+                pushed = true;
+            }
+            lk.unlock();
+            Py_END_ALLOW_THREADS
+            break;
+        case QUEUE_REJECT:
+            queue->rejected++;
+            lk.unlock();
+            releaseFrame(self, task);
+            Py_DECREF(future);
+            PyErr_SetString(PyExc_RuntimeError, "async queue is full");
+            return NULL;
+        }
+    }
+
+    if (queued && !pushed)
+    {
+        worker->tasks.push(task);
+        worker->cv.notify_one();
+    }
+
+    if (lk.owns_lock())
+        lk.unlock();
+    releaseFrames(self, dropped);
+
+    if (!queued)
+    {
+        // The returned future is cancelled.
+        releaseFrame(self, task);
+    }
+
+    return future;
+}
+
+/**
+ * Configure the queue used by decodeMatAsync().
+ *
+ * @param int capacity
+ * @param int policy applied when the queue is full: QUEUE_DROP_OLDEST, QUEUE_DROP_NEWEST, QUEUE_BLOCK or QUEUE_REJECT
+ * @param int timeout in milliseconds for QUEUE_BLOCK, 0 waits forever
+ *
+ * @return 0 on success
+ */
+static PyObject *setAsyncQueue(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+
+    int capacity;
+    int policy = QUEUE_DROP_OLDEST;
+    int timeout = 0;
+    if (!PyArg_ParseTuple(args, "i|ii", &capacity, &policy, &timeout))
+    {
+        return NULL;
+    }
+
+    if (capacity < 1)
+    {
+        PyErr_SetString(PyExc_ValueError, "capacity must be at least 1");
+        return NULL;
+    }
+
+    if (policy < QUEUE_DROP_OLDEST || policy > QUEUE_REJECT)
+    {
+        PyErr_SetString(PyExc_ValueError, "unknown queue policy");
+        return NULL;
+    }
+
+    std::unique_lock<std::mutex> lk;
+    if (self->worker)
+        lk = std::unique_lock<std::mutex>(self->worker->m);
+
+    self->queue->capacity = capacity;
+    self->queue->policy = policy;
+    self->queue->timeout = timeout < 0 ? 0 : timeout;
+
+    if (self->worker)
+        self->worker->notFull.notify_all();
+
+    return Py_BuildValue("i", 0);
+}
+
+/**
+ * Reduce decodeMatAsync() frames while they are copied, so the queue holds and
+ * the recognizer reads only what is needed. Results still refer to the whole
+ * frame. Gray conversion is enabled with setPreprocessing() and done in the
+ * same pass. In zero-copy mode, only the region of interest applies.
+ *
+ * @param int downscale factor, e.g. 2, 1 keeps the resolution
+ * @param tuple region of interest (x, y, width, height), or None for the
+ *              whole frame. Defaults to None.
+ *
+ * @return 0 on success
+ */
+static PyObject *setAsyncIngest(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+
+    int factor;
+    PyObject *roi = Py_None;
+    if (!PyArg_ParseTuple(args, "i|O", &factor, &roi))
+    {
+        return NULL;
+    }
+
+    int rect[4];
+    if (roi != Py_None)
+    {
+        PyObject *tuple = PySequence_Tuple(roi);
+        if (tuple == NULL)
+            return NULL;
+        int ok = PyArg_ParseTuple(tuple, "iiii", &rect[0], &rect[1], &rect[2], &rect[3]);
+        Py_DECREF(tuple);
+        if (!ok)
+            return NULL;
+    }
+    if (roi != Py_None && (rect[2] <= 0 || rect[3] <= 0))
+    {
+        PyErr_SetString(PyExc_ValueError, "region of interest must not be empty");
+        return NULL;
+    }
+
+    self->ingest->factor = factor > 1 ? factor : 1;
+    self->ingest->crop = roi != Py_None;
+    if (self->ingest->crop)
+        memcpy(self->ingest->roi, rect, sizeof(rect));
+
+    return Py_BuildValue("i", 0);
+}
+
+/**
+ * Configure the frame buffers used by decodeMatAsync().
+ *
+ * @param int number of idle buffers kept for reuse
+ * @param bool zero-copy mode: queue a reference to the image instead of a copy.
+ *             The image must not be modified until its result is delivered.
+ *
+ * @return 0 on success
+ */
+static PyObject *setFramePool(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+
+    int capacity;
+    int zeroCopy = 0;
+    if (!PyArg_ParseTuple(args, "i|p", &capacity, &zeroCopy))
+    {
+        return NULL;
+    }
+
+    if (capacity < 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "capacity must not be negative");
+        return NULL;
+    }
+
+    std::lock_guard<std::mutex> lk(self->framePool->m);
+    self->framePool->capacity = capacity;
+    self->framePool->zeroCopy = zeroCopy != 0;
+    while (self->framePool->buffers.size() > (size_t)capacity)
+    {
+        alignedFree(self->framePool->buffers.front().data);
+        self->framePool->buffers.erase(self->framePool->buffers.begin());
+    }
+
+    return Py_BuildValue("i", 0);
+}
+
+/**
+ * Get the async queue counters.
+ *
+ * @return dict of frame counts
+ */
+static PyObject *getAsyncStats(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+
+    size_t queued = 0;
+    if (self->worker)
+    {
+        std::lock_guard<std::mutex> lk(self->worker->m);
+        queued = self->worker->tasks.size();
+    }
+
+    AsyncQueue *queue = self->queue;
+    return Py_BuildValue("{s:n,s:n,s:n,s:n,s:n,s:n,s:n,s:n,s:n,s:n,s:n,s:n}",
+                         "queued", (Py_ssize_t)queued,
+                         "processed", (Py_ssize_t)queue->processed,
+                         "dropped_oldest", (Py_ssize_t)queue->droppedOldest,
+                         "dropped_newest", (Py_ssize_t)queue->droppedNewest,
+                         "timed_out", (Py_ssize_t)queue->timedOut,
+                         "rejected", (Py_ssize_t)queue->rejected,
+                         "blurry", (Py_ssize_t)queue->blurry,
+                         "duplicates", (Py_ssize_t)self->deduplicator->duplicates,
+                         "pool_hits", (Py_ssize_t)self->framePool->hits,
+                         "pool_misses", (Py_ssize_t)self->framePool->misses,
+                         "roi_tracked", (Py_ssize_t)self->tracker->tracked,
+                         "roi_lost", (Py_ssize_t)self->tracker->lost);
+}
+
+/**
+ * Find the MRZ band before recognition and recognize only that part of the
+ * image, falling back to the whole image when no band or no text is found.
+ * Applies to decodeMat(), decodeYUV() and decodeMatAsync().
+ *
+ * @param bool enabled
+ *
+ * @return 0 on success
+ */
+static PyObject *setMrzLocator(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+
+    int enabled;
+    if (!PyArg_ParseTuple(args, "p", &enabled))
+    {
+        return NULL;
+    }
+
+    self->pipeline->locateBand = enabled != 0;
+
+    return Py_BuildValue("i", 0);
+}
+
+/**
+ * Turn rotated images upright before recognition. The rotation is estimated
+ * natively from the text lines and the MRZ band, so a rotated image costs
+ * about one recognition pass. Applies to decodeMat(), decodeYUV() and
+ * decodeMatAsync().
+ *
+ * @param bool enabled
+ *
+ * @return 0 on success
+ */
+static PyObject *setAutoRotate(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+
+    int enabled;
+    if (!PyArg_ParseTuple(args, "p", &enabled))
+    {
+        return NULL;
+    }
+
+    self->pipeline->autoRotate = enabled != 0;
+
+    return Py_BuildValue("i", 0);
+}
+
+/**
+ * Recognize skewed MRZ regions in a rectified strip. The MRZ quad is warped
+ * into an axis-aligned strip of the given height with bilinear sampling. A
+ * read that fails its check digits is retried in the strip, and tracked
+ * decodeMatAsync() frames are recognized in the strip only. Applies to
+ * decodeMat(), decodeYUV() and decodeMatAsync().
+ *
+ * @param int strip height in pixels, 0 disables rectification
+ *
+ * @return 0 on success
+ */
+static PyObject *setRectification(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+
+    int stripHeight;
+    if (!PyArg_ParseTuple(args, "i", &stripHeight))
+    {
+        return NULL;
+    }
+
+    self->pipeline->stripHeight = stripHeight < 0 ? 0 : stripHeight;
+
+    return Py_BuildValue("i", 0);
+}
+
+/**
+ * Recognize large images at a lower resolution first. The image is shrunk by
+ * the factor with a box filter, and the full resolution is recognized only if
+ * the small image yields no MRZ that passes its check digits. Applies to
+ * decodeMat(), decodeYUV() and decodeMatAsync().
+ *
+ * @param int downscale factor, e.g. 4, 0 or 1 disables the pyramid
+ *
+ * @return 0 on success
+ */
+static PyObject *setPyramid(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+
+    int factor;
+    if (!PyArg_ParseTuple(args, "i", &factor))
+    {
+        return NULL;
+    }
+
+    self->pipeline->pyramidFactor = factor < 0 ? 0 : factor;
+
+    return Py_BuildValue("i", 0);
+}
+
+/**
+ * Prepare images before recognition. Color images are converted to gray with
+ * vector instructions chosen for the CPU at run time, so the recognizer gets a
+ * third of the bytes; decodeMatAsync() converts while copying the frame. The
+ * local contrast of the gray image can be normalized as well, for faded or
+ * unevenly lit documents. Applies to decodeMat(), decodeYUV() and
+ * decodeMatAsync().
+ *
+ * @param bool convert color images to gray
+ * @param float clip limit of the contrast normalization, e.g. 2.0, which
+ *              implies gray. Defaults to 0, which disables it.
+ *
+ * @return 0 on success
+ */
+static PyObject *setPreprocessing(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+
+    int grayscale;
+    double contrastClip = 0;
+    if (!PyArg_ParseTuple(args, "p|d", &grayscale, &contrastClip))
+    {
+        return NULL;
+    }
+
+    self->pipeline->grayscale = grayscale != 0;
+    self->pipeline->contrastClip = contrastClip < 0 ? 0 : contrastClip;
+
+    return Py_BuildValue("i", 0);
+}
+
+/**
+ * Estimate the rotation of an image, as used by setAutoRotate().
+ *
+ * @param Mat image
+ *
+ * @return the clockwise rotation in degrees (0, 90, 180 or 270) that makes the
+ *         text upright, or -1 if no text is found
+ */
+static PyObject *orientation(PyObject *obj, PyObject *args)
+{
+    PyObject *o;
+    if (!PyArg_ParseTuple(args, "O", &o))
+        return NULL;
+
+    ImageData data;
+    PyObject *owner = getImageData(o, &data);
+    if (owner == NULL)
+        return NULL;
+
+    int angle;
+    Py_BEGIN_ALLOW_THREADS
+    angle = getOrientation(&data);
+    Py_END_ALLOW_THREADS
+    Py_DECREF(owner);
+
+    return Py_BuildValue("i", angle);
+}
+
+/**
+ * Track the MRZ across decodeMatAsync() frames. After a confident read, later
+ * frames are recognized only in a padded region around the lines found, and
+ * the whole frame is searched again when the region yields no line or a line
+ * below the confidence threshold.
+ *
+ * @param bool enabled
+ * @param int lowest line confidence that keeps the region, defaults to 60
+ *
+ * @return 0 on success
+ */
+static PyObject *setRoiTracking(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+
+    int enabled;
+    int minConfidence = 60;
+    if (!PyArg_ParseTuple(args, "p|i", &enabled, &minConfidence))
+    {
+        return NULL;
+    }
+
+    std::lock_guard<std::mutex> lk(self->tracker->m);
+    self->tracker->enabled = enabled != 0;
+    self->tracker->minConfidence = minConfidence;
+    self->tracker->valid = false;
+
+    return Py_BuildValue("i", 0);
+}
+
+/**
+ * Recognize static scenes once. A decodeMatAsync() frame whose 32 x 32
+ * luminance thumbnail differs from the last recognized frame by less than the
+ * threshold is not recognized, and gets the results of that frame instead.
+ *
+ * @param float mean thumbnail difference in luminance levels (0-255) below
+ *              which frames are duplicates, 0 disables deduplication
+ *
+ * @return 0 on success
+ */
+static PyObject *setDeduplication(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+
+    double threshold;
+    if (!PyArg_ParseTuple(args, "d", &threshold))
+    {
+        return NULL;
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(self->deduplicator->m);
+        self->deduplicator->threshold = threshold < 0 ? 0 : threshold;
+        self->deduplicator->valid = false;
+    }
+    Py_CLEAR(self->deduplicator->results);
+
+    return Py_BuildValue("i", 0);
+}
+
+/**
+ * Skip decodeMatAsync() frames too blurred to be read, before recognition.
+ * Their futures are cancelled, and getAsyncStats() counts them as "blurry".
+ *
+ * @param float lowest sharpness() score recognized, 0 disables the gate
+ *
+ * @return 0 on success
+ */
+static PyObject *setQualityGate(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+
+    double minSharpness;
+    if (!PyArg_ParseTuple(args, "d", &minSharpness))
+    {
+        return NULL;
+    }
+
+    self->pipeline->minSharpness = minSharpness < 0 ? 0 : minSharpness;
+
+    return Py_BuildValue("i", 0);
+}
+
+/**
+ * Measure how sharp an image is, to pick the threshold of setQualityGate().
+ *
+ * @param Mat image
+ *
+ * @return the variance of the Laplacian of the image, sampled on a grid
+ */
+static PyObject *sharpness(PyObject *obj, PyObject *args)
+{
+    PyObject *o;
+    if (!PyArg_ParseTuple(args, "O", &o))
+        return NULL;
+
+    ImageData data;
+    PyObject *owner = getImageData(o, &data);
+    if (owner == NULL)
+        return NULL;
+
+    double score = getSharpness(&data);
+    Py_DECREF(owner);
+
+    return Py_BuildValue("d", score);
+}
+
+/**
+ * Enable multi-frame consensus for decodeMatAsync(). The lines of consecutive
+ * frames are aligned and voted on per character, weighted by confidence. The
+ * listener is called once, with the consensus as a parse() dict, when the voted
+ * lines pass their check digits for the given number of frames in a row.
+ * Later frames are cancelled without being recognized until resetConsensus().
+ *
+ * @param int number of agreeing frames required, 0 disables consensus
+ * @param bool correct the voted lines with the runner-up characters when a
+ *             check digit fails. Defaults to True.
+ *
+ * @return 0 on success
+ */
+static PyObject *setConsensus(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+
+    int frames;
+    int correct = 1;
+    if (!PyArg_ParseTuple(args, "i|p", &frames, &correct))
+    {
+        return NULL;
+    }
+
+    if (frames < 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "frames must not be negative");
+        return NULL;
+    }
+
+    self->consensus->reset();
+    {
+        std::lock_guard<std::mutex> lk(self->consensus->m);
+        self->consensus->correct = correct != 0;
+    }
+    self->consensus->frames = frames;
+
+    return Py_BuildValue("i", 0);
+}
+
+/**
+ * Start a new consensus, e.g. for the next document.
+ */
+static PyObject *resetConsensus(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+    self->consensus->reset();
+    Py_RETURN_NONE;
+}
+
+/**
+ * Get the consensus of decodeMatAsync() frames.
+ *
+ * @return a parse() dict, or None until the consensus is reached
+ */
+static PyObject *getConsensus(PyObject *obj, PyObject *args)
+{
+    return createPyConsensus((DynamsoftMrzReader *)obj);
+}
+
+/**
+ * Load MRZ configuration file.
+ *
+ * @param string template content
+ *
+ * @return loading status
+ */
+static PyObject *loadModel(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+
+    char *settings; // File name
+    if (!PyArg_ParseTuple(args, "s", &settings))
+    {
+        return NULL;
+    }
+
+    char errorMsgBuffer[512];
+    int ret;
+    {
+        std::lock_guard<std::mutex> lk(*self->handlerLock);
+        ret = DLR_AppendSettingsFromString(self->handler, settings, errorMsgBuffer, 512);
+    }
+    printf("Load MRZ model: %s\n", errorMsgBuffer);
+
+    if (ret == 0)
+    {
+        self->settings->push_back(settings);
+        if (self->worker)
+        {
+            std::lock_guard<std::mutex> lk(self->worker->handlerLock);
+            DLR_AppendSettingsFromString(self->worker->handler, settings, errorMsgBuffer, 512);
+        }
+        if (self->batchPool)
+        {
+            self->batchPool->loadSettings(settings, errorMsgBuffer, 512);
+        }
+    }
+
+    return Py_BuildValue("i", ret);
+}
+
+/**
+ * Register callback function to receive MRZ decoding result asynchronously.
+ */
+static PyObject *addAsyncListener(PyObject *obj, PyObject *args)
+{
+    DynamsoftMrzReader *self = (DynamsoftMrzReader *)obj;
+
+    PyObject *callback = NULL;
+    if (!PyArg_ParseTuple(args, "O", &callback))
+    {
+        return NULL;
+    }
+
+    if (!PyCallable_Check(callback))
+    {
+        PyErr_SetString(PyExc_TypeError, "parameter must be callable");
+        return NULL;
+    }
+    else
+    {
+        Py_XINCREF(callback);       /* Add a reference to new callback */
+        Py_XDECREF(self->callback); /* Dispose of previous callback */
+        self->callback = callback;
     }
 
-    printf("Running native thread...\n");
+    startWorker(self);
     return Py_BuildValue("i", 0);
 }
 
@@ -463,11 +1609,32 @@ static PyObject *clearAsyncListener(PyObject *obj, PyObject *args)
 
 static PyMethodDef instance_methods[] = {
     {"decodeFile", decodeFile, METH_VARARGS, NULL},
+    {"decodeBytes", decodeBytes, METH_VARARGS, NULL},
     {"decodeMat", decodeMat, METH_VARARGS, NULL},
+    {"decodeYUV", decodeYUV, METH_VARARGS, NULL},
+    {"decodeBatch", decodeBatch, METH_VARARGS, NULL},
     {"loadModel", loadModel, METH_VARARGS, NULL},
     {"addAsyncListener", addAsyncListener, METH_VARARGS, NULL},
     {"decodeMatAsync", decodeMatAsync, METH_VARARGS, NULL},
+    {"decode", decodeMatAsync, METH_VARARGS, NULL},
     {"clearAsyncListener", clearAsyncListener, METH_VARARGS, NULL},
+    {"setAsyncQueue", setAsyncQueue, METH_VARARGS, NULL},
+    {"getAsyncStats", getAsyncStats, METH_VARARGS, NULL},
+    {"setFramePool", setFramePool, METH_VARARGS, NULL},
+    {"setAsyncIngest", setAsyncIngest, METH_VARARGS, NULL},
+    {"setMrzLocator", setMrzLocator, METH_VARARGS, NULL},
+    {"setRoiTracking", setRoiTracking, METH_VARARGS, NULL},
+    {"setDeduplication", setDeduplication, METH_VARARGS, NULL},
+    {"setAutoRotate", setAutoRotate, METH_VARARGS, NULL},
+    {"orientation", orientation, METH_VARARGS, NULL},
+    {"setRectification", setRectification, METH_VARARGS, NULL},
+    {"setPyramid", setPyramid, METH_VARARGS, NULL},
+    {"setPreprocessing", setPreprocessing, METH_VARARGS, NULL},
+    {"setQualityGate", setQualityGate, METH_VARARGS, NULL},
+    {"sharpness", sharpness, METH_VARARGS, NULL},
+    {"setConsensus", setConsensus, METH_VARARGS, NULL},
+    {"getConsensus", getConsensus, METH_VARARGS, NULL},
+    {"resetConsensus", resetConsensus, METH_VARARGS, NULL},
     {NULL, NULL, 0, NULL}};
 
 static PyTypeObject DynamsoftMrzReaderType = {
@@ -0,0 +1,114 @@
+#ifndef __FRAME_POOL_H__
+#define __FRAME_POOL_H__
+
+#include <stdlib.h>
+#include <mutex>
+#include <atomic>
+#include <vector>
+
+#define FRAME_ALIGNMENT 64
+
+unsigned char *alignedMalloc(size_t size)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    return (unsigned char *)_aligned_malloc(size, FRAME_ALIGNMENT);
+#else
+    void *p = NULL;
+    if (posix_memalign(&p, FRAME_ALIGNMENT, size))
+        return NULL;
+    return (unsigned char *)p;
+#endif
+}
+
+void alignedFree(unsigned char *p)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+class FrameBuffer
+{
+public:
+    unsigned char *data;
+    size_t size;
+};
+
+/**
+ * Reusable 64-byte-aligned frame buffers for decodeMatAsync(). Buffers are
+ * matched by size, so a camera running at a fixed resolution stops hitting
+ * the allocator once the pool is warm.
+ */
+class FramePool
+{
+public:
+    std::mutex m;
+    std::vector<FrameBuffer> buffers;
+    size_t capacity = 4; // idle buffers kept for reuse
+    bool zeroCopy = false;
+
+    std::atomic<size_t> hits;
+    std::atomic<size_t> misses;
+
+    FramePool() : hits(0), misses(0) {}
+
+    ~FramePool()
+    {
+        clear();
+    }
+
+    unsigned char *acquire(size_t size)
+    {
+        {
+            std::lock_guard<std::mutex> lk(m);
+            for (size_t i = 0; i < buffers.size(); i++)
+            {
+                if (buffers[i].size == size)
+                {
+                    unsigned char *data = buffers[i].data;
+                    buffers.erase(buffers.begin() + i);
+                    hits++;
+                    return data;
+                }
+            }
+        }
+
+        misses++;
+        return alignedMalloc(size);
+    }
+
+    void release(unsigned char *data, size_t size)
+    {
+        std::lock_guard<std::mutex> lk(m);
+        if (buffers.size() >= capacity)
+        {
+            // Evict the least recently returned buffer, usually one left over from a previous resolution.
+            if (buffers.empty())
+            {
+                alignedFree(data);
+                return;
+            }
+            alignedFree(buffers.front().data);
+            buffers.erase(buffers.begin());
+        }
+
+        FrameBuffer buffer;
+        buffer.data = data;
+        buffer.size = size;
+        buffers.push_back(buffer);
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lk(m);
+        for (size_t i = 0; i < buffers.size(); i++)
+        {
+            alignedFree(buffers[i].data);
+        }
+        buffers.clear();
+    }
+};
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef __FUTURE_UTILS_H__
+#define __FUTURE_UTILS_H__
+
+#include <Python.h>
+
+/**
+ * Let concurrent.futures.wait() and as_completed() see that a cancelled
+ * concurrent.futures.Future is done, as executors do before running a task.
+ * cancel() alone only wakes result() callers. Other futures are left as is.
+ */
+static void notifyCancelled(PyObject *future)
+{
+    if (!PyObject_HasAttrString(future, "set_running_or_notify_cancel"))
+        return;
+
+    PyObject *cancelled = PyObject_CallMethod(future, "cancelled", NULL);
+    int isCancelled = cancelled ? PyObject_IsTrue(cancelled) : 0;
+    Py_XDECREF(cancelled);
+    if (isCancelled == 1)
+    {
+        // Raises if the waiters were already notified.
+        PyObject *ret = PyObject_CallMethod(future, "set_running_or_notify_cancel", NULL);
+        Py_XDECREF(ret);
+    }
+    PyErr_Clear();
+}
+
+/**
+ * Set the result of a future unless it is already done (e.g. cancelled).
+ * Runs on the event loop thread for asyncio futures.
+ */
+static PyObject *setFutureResult(PyObject *self, PyObject *args)
+{
+    PyObject *future, *result;
+    if (!PyArg_ParseTuple(args, "OO", &future, &result))
+        return NULL;
+
+    PyObject *done = PyObject_CallMethod(future, "done", NULL);
+    if (done == NULL)
+        return NULL;
+
+    int isDone = PyObject_IsTrue(done);
+    Py_DECREF(done);
+    if (!isDone)
+    {
+        PyObject *ret = PyObject_CallMethod(future, "set_result", "O", result);
+        if (ret == NULL)
+            return NULL;
+        Py_DECREF(ret);
+    }
+    else
+    {
+        notifyCancelled(future);
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef setFutureResultDef = {"_set_future_result", setFutureResult, METH_VARARGS, NULL};
+
+/**
+ * Create a future for an asynchronous result. It is an asyncio future when
+ * called from a running event loop, and a concurrent.futures.Future otherwise.
+ *
+ * @return new reference, or NULL on failure
+ */
+PyObject *createFuture()
+{
+    PyObject *asyncio = PyImport_ImportModule("asyncio");
+    if (asyncio == NULL)
+        return NULL;
+
+    PyObject *loop = PyObject_CallMethod(asyncio, "_get_running_loop", NULL);
+    Py_DECREF(asyncio);
+    if (loop == NULL)
+        return NULL;
+
+    if (loop != Py_None)
+    {
+        PyObject *future = PyObject_CallMethod(loop, "create_future", NULL);
+        Py_DECREF(loop);
+        return future;
+    }
+    Py_DECREF(loop);
+
+    PyObject *futures = PyImport_ImportModule("concurrent.futures");
+    if (futures == NULL)
+        return NULL;
+
+    PyObject *future = PyObject_CallMethod(futures, "Future", NULL);
+    Py_DECREF(futures);
+    return future;
+}
+
+/**
+ * Complete a future with a result. Requires the GIL.
+ *
+ * asyncio futures are completed on their event loop through
+ * call_soon_threadsafe(); errors are discarded since there is no caller to
+ * report them to (e.g. the loop has been closed).
+ */
+void resolveFuture(PyObject *future, PyObject *result)
+{
+    static PyObject *setter = NULL;
+    if (setter == NULL)
+        setter = PyCFunction_New(&setFutureResultDef, NULL);
+
+    PyObject *ret;
+    PyObject *loop = PyObject_CallMethod(future, "get_loop", NULL);
+    if (loop == NULL)
+    {
+        // concurrent.futures.Future can be completed from any thread.
+        PyErr_Clear();
+        ret = PyObject_CallFunctionObjArgs(setter, future, result, NULL);
+    }
+    else
+    {
+        ret = PyObject_CallMethod(loop, "call_soon_threadsafe", "OOO", setter, future, result);
+        Py_DECREF(loop);
+    }
+
+    if (ret == NULL)
+        PyErr_Clear();
+    Py_XDECREF(ret);
+}
+
+/**
+ * Cancel a future whose frame will never be recognized. Requires the GIL.
+ */
+void cancelFuture(PyObject *future)
+{
+    PyObject *ret;
+    PyObject *loop = PyObject_CallMethod(future, "get_loop", NULL);
+    if (loop == NULL)
+    {
+        PyErr_Clear();
+        ret = PyObject_CallMethod(future, "cancel", NULL);
+        if (ret != NULL)
+            notifyCancelled(future);
+    }
+    else
+    {
+        PyObject *cancel = PyObject_GetAttrString(future, "cancel");
+        ret = cancel ? PyObject_CallMethod(loop, "call_soon_threadsafe", "O", cancel) : NULL;
+        Py_XDECREF(cancel);
+        Py_DECREF(loop);
+    }
+
+    if (ret == NULL)
+        PyErr_Clear();
+    Py_XDECREF(ret);
+}
+
+#endif
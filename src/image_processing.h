@@ -0,0 +1,980 @@
+#ifndef __IMAGE_PROCESSING_H__
+#define __IMAGE_PROCESSING_H__
+
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define GRAY_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define GRAY_NEON
+#include <arm_neon.h>
+#endif
+
+/**
+ * Copy rows between buffers of different strides.
+ */
+void copyRows(unsigned char *dst, int dstStride, const unsigned char *src, int srcStride, int rowBytes, int height)
+{
+    if (dstStride == rowBytes && srcStride == rowBytes)
+    {
+        memcpy(dst, src, (size_t)rowBytes * height);
+        return;
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+        memcpy(dst + (size_t)y * dstStride, src + (ptrdiff_t)y * srcStride, rowBytes);
+    }
+}
+
+/**
+ * Gather an arbitrarily strided image (e.g. a transposed or reversed view)
+ * into a packed buffer.
+ *
+ * @param strides byte steps between rows, columns and channels
+ */
+void gatherImage(unsigned char *dst, const unsigned char *src, const ptrdiff_t strides[3],
+                 int width, int height, int channels, int itemSize)
+{
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char *row = src + y * strides[0];
+        for (int x = 0; x < width; x++)
+        {
+            const unsigned char *pixel = row + x * strides[1];
+            for (int c = 0; c < channels; c++)
+            {
+                memcpy(dst, pixel + c * strides[2], itemSize);
+                dst += itemSize;
+            }
+        }
+    }
+}
+
+/**
+ * Reduce a 16-bit grayscale image to 8 bits by keeping the high byte.
+ */
+void gray16ToGray8(unsigned char *dst, const unsigned char *src, const ptrdiff_t strides[2], int width, int height)
+{
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char *row = src + y * strides[0];
+        for (int x = 0; x < width; x++)
+        {
+            uint16_t value;
+            memcpy(&value, row + x * strides[1], 2);
+            *dst++ = (unsigned char)(value >> 8);
+        }
+    }
+}
+
+/**
+ * Extract the luma channel of a packed YUYV frame.
+ */
+void extractLuma(unsigned char *dst, const unsigned char *src, int srcStride, int width, int height)
+{
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char *row = src + (size_t)y * srcStride;
+        for (int x = 0; x < width; x++)
+        {
+            *dst++ = row[x * 2];
+        }
+    }
+}
+
+/**
+ * Approximate luminance of a pixel: the gray value, or (B + 2G + R) / 4 for
+ * color pixels. 16-bit pixels use their high byte.
+ */
+inline int sampleLuma(const unsigned char *pixel, int channels, int itemSize)
+{
+    const unsigned char *high = pixel + itemSize - 1;
+    if (channels < 3)
+        return high[0];
+    return (high[0] + 2 * high[itemSize] + high[itemSize * 2]) >> 2;
+}
+
+/**
+ * Find the band of dense horizontal text where a machine readable zone is,
+ * on a grid of at most 320 x 320 samples. Rows are scored by their share of
+ * strong horizontal transitions, which runs of '<' and monospaced OCR-B text
+ * maximize, and the best scoring run of rows wins.
+ *
+ * The transition count is a scalar pass: the grid bounds the work to about
+ * 100k samples per frame whatever its size, and gathering the strided samples
+ * costs more than the comparisons a gradient kernel would vectorize.
+ *
+ * @param rect x, y, width and height of the band, padded by half its height
+ *
+ * @return false if no band is found, or if it covers most of the image
+ */
+bool locateTextBand(const unsigned char *bytes, int width, int height, int stride,
+                    int channels, int itemSize, int rect[4])
+{
+    const int GRID = 320;
+    const int EDGE = 32; // luminance step counted as a transition
+    int columns = width < GRID ? width : GRID;
+    int rows = height < GRID ? height : GRID;
+    if (columns < 16 || rows < 16)
+        return false;
+
+    std::vector<int> xs(columns);
+    int pixelBytes = channels * itemSize;
+    for (int i = 0; i < columns; i++)
+        xs[i] = (int)((int64_t)i * width / columns) * pixelBytes;
+
+    // Transitions per sampled row, and per sampled pixel for the column extent.
+    std::vector<int> density(rows);
+    std::vector<unsigned char> edges((size_t)rows * columns);
+    std::vector<int> luma(columns);
+    for (int r = 0; r < rows; r++)
+    {
+        const unsigned char *row = bytes + (int64_t)r * height / rows * stride;
+        for (int i = 0; i < columns; i++)
+            luma[i] = sampleLuma(row + xs[i], channels, itemSize);
+
+        int count = 0;
+        for (int i = 0; i + 1 < columns; i++)
+        {
+            int step = luma[i + 1] - luma[i];
+            unsigned char edge = step > EDGE || step < -EDGE;
+            edges[(size_t)r * columns + i] = edge;
+            count += edge;
+        }
+        density[r] = count;
+    }
+
+    int maxDensity = 0;
+    for (int r = 0; r < rows; r++)
+        maxDensity = density[r] > maxDensity ? density[r] : maxDensity;
+
+    int threshold = maxDensity / 2;
+    if (threshold < columns / 10)
+        threshold = columns / 10;
+    if (maxDensity < threshold || maxDensity == 0)
+        return false;
+
+    // Merge text rows separated by gaps up to a line height, e.g. between MRZ lines.
+    int minGap = rows / 60 > 1 ? rows / 60 : 1;
+    int bestStart = -1, bestEnd = -1, bestScore = 0;
+    int start = -1, end = -1, score = 0;
+    for (int r = 0; r <= rows; r++)
+    {
+        bool text = r < rows && density[r] >= threshold;
+        int gap = end - start + 1 > minGap ? end - start + 1 : minGap;
+        if (text && start >= 0 && r - end - 1 <= gap)
+        {
+            end = r;
+            score += density[r];
+            continue;
+        }
+
+        if (!text && r < rows)
+            continue;
+
+        // A new band starts, or the rows end: keep the best band so far.
+        if (start >= 0 && end > start && score > bestScore)
+        {
+            bestStart = start;
+            bestEnd = end;
+            bestScore = score;
+        }
+        start = end = r;
+        score = text ? density[r] : 0;
+    }
+    if (bestStart < 0)
+        return false;
+
+    // The band spans the columns where its rows have transitions.
+    int bandRows = bestEnd - bestStart + 1;
+    int minCount = bandRows / 4 > 1 ? bandRows / 4 : 1;
+    int left = -1, right = -1;
+    for (int i = 0; i + 1 < columns; i++)
+    {
+        int count = 0;
+        for (int r = bestStart; r <= bestEnd; r++)
+            count += edges[(size_t)r * columns + i];
+        if (count >= minCount)
+        {
+            if (left < 0)
+                left = i;
+            right = i + 1;
+        }
+    }
+    if (left < 0)
+        return false;
+
+    int y0 = (int)((int64_t)bestStart * height / rows);
+    int y1 = (int)((int64_t)(bestEnd + 1) * height / rows);
+    int x0 = (int)((int64_t)left * width / columns);
+    int x1 = (int)((int64_t)(right + 1) * width / columns);
+    int padY = (y1 - y0) / 2 + height / rows;
+    int padX = width / 40 + width / columns;
+    x0 = x0 - padX > 0 ? x0 - padX : 0;
+    y0 = y0 - padY > 0 ? y0 - padY : 0;
+    x1 = x1 + padX < width ? x1 + padX : width;
+    y1 = y1 + padY < height ? y1 + padY : height;
+
+    if ((int64_t)(x1 - x0) * (y1 - y0) * 10 > (int64_t)width * height * 7)
+        return false;
+
+    rect[0] = x0;
+    rect[1] = y0;
+    rect[2] = x1 - x0;
+    rect[3] = y1 - y0;
+    return true;
+}
+
+/**
+ * Focus measure: the variance of the 4-neighbour Laplacian of the luminance,
+ * sampled on a grid of at most 256 x 256 pixels. Motion blur and defocus
+ * remove the fine edges of text, so blurred frames score low.
+ */
+double measureSharpness(const unsigned char *bytes, int width, int height, int stride, int channels, int itemSize)
+{
+    const int GRID = 256;
+    if (width < 3 || height < 3)
+        return 0;
+
+    int columns = width - 2 < GRID ? width - 2 : GRID;
+    int rows = height - 2 < GRID ? height - 2 : GRID;
+    int pixelBytes = channels * itemSize;
+    double sum = 0, sumSquares = 0;
+    for (int r = 0; r < rows; r++)
+    {
+        const unsigned char *row = bytes + (1 + (int64_t)r * (height - 2) / rows) * stride;
+        for (int i = 0; i < columns; i++)
+        {
+            const unsigned char *pixel = row + (1 + (int64_t)i * (width - 2) / columns) * pixelBytes;
+            int laplacian = 4 * sampleLuma(pixel, channels, itemSize) -
+                            sampleLuma(pixel - pixelBytes, channels, itemSize) -
+                            sampleLuma(pixel + pixelBytes, channels, itemSize) -
+                            sampleLuma(pixel - stride, channels, itemSize) -
+                            sampleLuma(pixel + stride, channels, itemSize);
+            sum += laplacian;
+            sumSquares += (double)laplacian * laplacian;
+        }
+    }
+
+    double count = (double)rows * columns;
+    double mean = sum / count;
+    return sumSquares / count - mean * mean;
+}
+
+/**
+ * Sum of the densest tenth of the transition counts, which is high along the
+ * lines of text and low across them.
+ */
+static int64_t topDensity(std::vector<int> &density)
+{
+    size_t count = density.size() / 10 + 1;
+    std::nth_element(density.begin(), density.begin() + (count - 1), density.end(), std::greater<int>());
+    int64_t sum = 0;
+    for (size_t i = 0; i < count; i++)
+        sum += density[i];
+    return sum;
+}
+
+/**
+ * Estimate the clockwise rotation, 0, 90, 180 or 270 degrees, that makes the
+ * text of an image upright. The text direction comes from the luminance
+ * transitions on a grid of at most 320 x 320 pixels, which are dense along
+ * text lines and sparse across them. The side then comes from the MRZ band:
+ * its lines end with '<' fillers, so the right end holds less ink than the
+ * left one when the document is upright.
+ *
+ * @return the rotation, or -1 if the image holds no text
+ */
+int estimateOrientation(const unsigned char *bytes, int width, int height, int stride, int channels, int itemSize)
+{
+    const int GRID = 320;
+    const int EDGE = 32;
+    int longest = width > height ? width : height;
+    int columns = longest > GRID ? (int)((int64_t)width * GRID / longest) : width;
+    int rows = longest > GRID ? (int)((int64_t)height * GRID / longest) : height;
+    if (columns < 16 || rows < 16)
+        return -1;
+
+    int pixelBytes = channels * itemSize;
+    std::vector<unsigned char> grid((size_t)rows * columns);
+    for (int r = 0; r < rows; r++)
+    {
+        const unsigned char *row = bytes + (int64_t)r * height / rows * stride;
+        for (int i = 0; i < columns; i++)
+            grid[(size_t)r * columns + i] = (unsigned char)sampleLuma(row + (int64_t)i * width / columns * pixelBytes, channels, itemSize);
+    }
+
+    std::vector<int> rowDensity(rows, 0), columnDensity(columns, 0);
+    for (int r = 0; r < rows; r++)
+    {
+        const unsigned char *row = &grid[(size_t)r * columns];
+        for (int i = 0; i < columns; i++)
+        {
+            if (i + 1 < columns && abs(row[i + 1] - row[i]) > EDGE)
+                rowDensity[r]++;
+            if (r + 1 < rows && abs(row[columns + i] - row[i]) > EDGE)
+                columnDensity[i]++;
+        }
+    }
+    int64_t horizontal = topDensity(rowDensity) * columns;
+    int64_t vertical = topDensity(columnDensity) * rows;
+    if (horizontal == 0 && vertical == 0)
+        return -1;
+
+    // Bring vertical text lines upright or upside down by turning the grid clockwise.
+    int angle = 0;
+    if (vertical > horizontal)
+    {
+        std::vector<unsigned char> turned(grid.size());
+        for (int r = 0; r < rows; r++)
+            for (int i = 0; i < columns; i++)
+                turned[(size_t)i * rows + (rows - 1 - r)] = grid[(size_t)r * columns + i];
+        grid.swap(turned);
+        std::swap(rows, columns);
+        angle = 90;
+    }
+
+    int rect[4] = {0, 0, columns, rows};
+    locateTextBand(&grid[0], columns, rows, columns, 1, 1, rect);
+
+    // Count dark samples in the left and right thirds of the band.
+    int sum = 0;
+    for (int r = rect[1]; r < rect[1] + rect[3]; r++)
+        for (int i = rect[0]; i < rect[0] + rect[2]; i++)
+            sum += grid[(size_t)r * columns + i];
+    int dark = sum / (rect[2] * rect[3]) - 16;
+    int third = rect[2] / 3;
+    int left = 0, right = 0;
+    for (int r = rect[1]; r < rect[1] + rect[3]; r++)
+    {
+        const unsigned char *row = &grid[(size_t)r * columns + rect[0]];
+        for (int i = 0; i < third; i++)
+        {
+            left += row[i] < dark;
+            right += row[rect[2] - 1 - i] < dark;
+        }
+    }
+
+    return left < right ? angle + 180 : angle;
+}
+
+/**
+ * Copy an image rotated clockwise by 90, 180 or 270 degrees into a packed
+ * buffer. The source is walked in tiles so that the scattered writes of a
+ * quarter turn stay in cache, and the rotation costs about one pass over the
+ * pixels.
+ */
+template <int PIXEL>
+static void rotatePixels(const unsigned char *src, int width, int height, int stride, int angle, unsigned char *dst)
+{
+    const int TILE = 64;
+    int64_t dstStride = (int64_t)(angle == 180 ? width : height) * PIXEL;
+
+    // Destination offset of source pixel (x, y): base + x * stepX + y * stepY.
+    int64_t base, stepX, stepY;
+    if (angle == 90)
+    {
+        base = (int64_t)(height - 1) * PIXEL;
+        stepX = dstStride;
+        stepY = -PIXEL;
+    }
+    else if (angle == 180)
+    {
+        base = (int64_t)(height - 1) * dstStride + (int64_t)(width - 1) * PIXEL;
+        stepX = -PIXEL;
+        stepY = -dstStride;
+    }
+    else
+    {
+        base = (int64_t)(width - 1) * dstStride;
+        stepX = -dstStride;
+        stepY = PIXEL;
+    }
+
+    for (int ty = 0; ty < height; ty += TILE)
+    {
+        int yEnd = ty + TILE < height ? ty + TILE : height;
+        for (int tx = 0; tx < width; tx += TILE)
+        {
+            int xEnd = tx + TILE < width ? tx + TILE : width;
+            for (int y = ty; y < yEnd; y++)
+            {
+                const unsigned char *in = src + (int64_t)y * stride + (int64_t)tx * PIXEL;
+                unsigned char *out = dst + base + (int64_t)tx * stepX + (int64_t)y * stepY;
+                for (int x = tx; x < xEnd; x++, in += PIXEL, out += stepX)
+                    memcpy(out, in, PIXEL);
+            }
+        }
+    }
+}
+
+/**
+ * Rotate an image clockwise by 90, 180 or 270 degrees, see rotatePixels().
+ * The destination holds width x height pixels, packed.
+ */
+void rotateImage(const unsigned char *src, int width, int height, int stride, int pixelBytes, int angle, unsigned char *dst)
+{
+    switch (pixelBytes)
+    {
+    case 1:
+        rotatePixels<1>(src, width, height, stride, angle, dst);
+        break;
+    case 2:
+        rotatePixels<2>(src, width, height, stride, angle, dst);
+        break;
+    case 3:
+        rotatePixels<3>(src, width, height, stride, angle, dst);
+        break;
+    case 4:
+        rotatePixels<4>(src, width, height, stride, angle, dst);
+        break;
+    case 6:
+        rotatePixels<6>(src, width, height, stride, angle, dst);
+        break;
+    case 8:
+        rotatePixels<8>(src, width, height, stride, angle, dst);
+        break;
+    }
+}
+
+/**
+ * Maps an axis-aligned strip onto a quad of an image, whose corners are given
+ * clockwise from the top left, through the projective transform of the unit
+ * square onto the quad. The quad is padded by padX and padY times its size,
+ * and the strip is height pixels high, with the width that keeps the aspect
+ * ratio of the padded quad.
+ */
+class QuadStrip
+{
+public:
+    int width = 0;
+    int height = 0;
+
+    QuadStrip(const double quad[8], int stripHeight, double padX, double padY) : padX(padX), padY(padY)
+    {
+        double x0 = quad[0], y0 = quad[1], x1 = quad[2], y1 = quad[3];
+        double x2 = quad[4], y2 = quad[5], x3 = quad[6], y3 = quad[7];
+        double sx = x0 - x1 + x2 - x3, sy = y0 - y1 + y2 - y3;
+        double dx1 = x1 - x2, dx2 = x3 - x2, dy1 = y1 - y2, dy2 = y3 - y2;
+        double den = dx1 * dy2 - dx2 * dy1;
+        g = den != 0 ? (sx * dy2 - dx2 * sy) / den : 0;
+        h = den != 0 ? (dx1 * sy - sx * dy1) / den : 0;
+        a = x1 - x0 + g * x1;
+        b = x3 - x0 + h * x3;
+        c = x0;
+        d = y1 - y0 + g * y1;
+        e = y3 - y0 + h * y3;
+        f = y0;
+
+        double across = (hypot(x1 - x0, y1 - y0) + hypot(x2 - x3, y2 - y3)) / 2;
+        double down = (hypot(x3 - x0, y3 - y0) + hypot(x2 - x1, y2 - y1)) / 2;
+        if (across < 1 || down < 1 || stripHeight < 1)
+            return;
+
+        height = stripHeight;
+        width = (int)(stripHeight * across * (1 + 2 * padX) / (down * (1 + 2 * padY)) + 0.5);
+        if (width < 1)
+            width = 1;
+    }
+
+    /**
+     * Image coordinates of a point of the strip.
+     */
+    void toImage(double u, double v, double &x, double &y) const
+    {
+        double s = u / width * (1 + 2 * padX) - padX;
+        double t = v / height * (1 + 2 * padY) - padY;
+        double w = g * s + h * t + 1;
+        x = (a * s + b * t + c) / w;
+        y = (d * s + e * t + f) / w;
+    }
+
+private:
+    double a, b, c, d, e, f, g, h;
+    double padX, padY;
+};
+
+/**
+ * Warp a quad of an image into a packed strip with bilinear sampling, see
+ * QuadStrip. Weights are 8-bit fixed point, and samples outside the image
+ * repeat its edge.
+ */
+template <typename T>
+static void warpPixels(const unsigned char *bytes, int width, int height, int stride, int channels,
+                       const QuadStrip &strip, unsigned char *dst)
+{
+    for (int v = 0; v < strip.height; v++)
+    {
+        T *out = (T *)(dst + (size_t)v * strip.width * channels * sizeof(T));
+        for (int u = 0; u < strip.width; u++, out += channels)
+        {
+            double x, y;
+            strip.toImage(u + 0.5, v + 0.5, x, y);
+            x -= 0.5;
+            y -= 0.5;
+            x = x < 0 ? 0 : (x > width - 1 ? width - 1 : x);
+            y = y < 0 ? 0 : (y > height - 1 ? height - 1 : y);
+
+            int x0 = (int)x, y0 = (int)y;
+            int x1 = x0 + 1 < width ? x0 + 1 : x0;
+            int y1 = y0 + 1 < height ? y0 + 1 : y0;
+            uint32_t fx = (uint32_t)((x - x0) * 256), fy = (uint32_t)((y - y0) * 256);
+            uint32_t w00 = (256 - fx) * (256 - fy), w01 = fx * (256 - fy), w10 = (256 - fx) * fy, w11 = fx * fy;
+
+            const T *row0 = (const T *)(bytes + (int64_t)y0 * stride);
+            const T *row1 = (const T *)(bytes + (int64_t)y1 * stride);
+            const T *p00 = row0 + x0 * channels, *p01 = row0 + x1 * channels;
+            const T *p10 = row1 + x0 * channels, *p11 = row1 + x1 * channels;
+            for (int k = 0; k < channels; k++)
+                out[k] = (T)((p00[k] * w00 + p01[k] * w01 + p10[k] * w10 + p11[k] * w11 + 32768) >> 16);
+        }
+    }
+}
+
+/**
+ * Warp a quad of an image into a strip.width x strip.height packed strip of
+ * the same pixel format.
+ */
+void warpQuad(const unsigned char *bytes, int width, int height, int stride, int channels, int itemSize,
+              const QuadStrip &strip, unsigned char *dst)
+{
+    if (itemSize == 2)
+        warpPixels<uint16_t>(bytes, width, height, stride, channels, strip, dst);
+    else
+        warpPixels<unsigned char>(bytes, width, height, stride, channels, strip, dst);
+}
+
+/**
+ * Shrink an image by an integer factor, averaging each factor x factor block.
+ * The rows of a block are summed into one accumulator row, so the source is
+ * read once, in order. Edge pixels that do not fill a block are dropped.
+ */
+template <typename T>
+static void boxDownscale(const unsigned char *bytes, int width, int height, int stride, int channels,
+                         int factor, unsigned char *dst)
+{
+    int dstWidth = width / factor;
+    int dstHeight = height / factor;
+    int values = dstWidth * channels;
+    uint32_t area = (uint32_t)(factor * factor);
+    std::vector<uint32_t> sums(values);
+    for (int y = 0; y < dstHeight; y++)
+    {
+        std::fill(sums.begin(), sums.end(), 0);
+        for (int r = 0; r < factor; r++)
+        {
+            const T *in = (const T *)(bytes + (int64_t)(y * factor + r) * stride);
+            for (int x = 0; x < dstWidth; x++)
+            {
+                uint32_t *sum = &sums[x * channels];
+                for (int i = 0; i < factor; i++, in += channels)
+                    for (int k = 0; k < channels; k++)
+                        sum[k] += in[k];
+            }
+        }
+
+        T *out = (T *)(dst + (size_t)y * values * sizeof(T));
+        for (int i = 0; i < values; i++)
+            out[i] = (T)((sums[i] + area / 2) / area);
+    }
+}
+
+/**
+ * Shrink an image by an integer factor into a packed buffer of
+ * (width / factor) x (height / factor) pixels, see boxDownscale().
+ */
+void downscaleImage(const unsigned char *bytes, int width, int height, int stride, int channels, int itemSize,
+                    int factor, unsigned char *dst)
+{
+    if (itemSize == 2)
+        boxDownscale<uint16_t>(bytes, width, height, stride, channels, factor, dst);
+    else
+        boxDownscale<unsigned char>(bytes, width, height, stride, channels, factor, dst);
+}
+
+// BT.601 luma weights of the blue, green and red channels, in 1/256.
+#define GRAY_B 29
+#define GRAY_G 150
+#define GRAY_R 77
+
+/**
+ * Convert 8-bit BGR or BGRA pixels to gray, one at a time.
+ */
+static void grayRowScalar(unsigned char *dst, const unsigned char *src, int width, int channels)
+{
+    for (int x = 0; x < width; x++, src += channels)
+        dst[x] = (unsigned char)((GRAY_B * src[0] + GRAY_G * src[1] + GRAY_R * src[2] + 128) >> 8);
+}
+
+/**
+ * Convert the leading pixels of a row of 8-bit BGR or BGRA pixels to gray
+ * with vector instructions.
+ *
+ * @return the number of pixels converted, the rest is left to grayRowScalar()
+ */
+typedef int (*GrayRowKernel)(unsigned char *dst, const unsigned char *src, int width, int channels);
+
+#ifdef GRAY_X86
+/**
+ * Shuffle mask gathering one channel of 16 interleaved pixels from the 16-byte
+ * block at index block of the pixels.
+ */
+static __m128i grayPlaneMask(int channels, int channel, int block)
+{
+    char mask[16];
+    for (int p = 0; p < 16; p++)
+    {
+        int index = channels * p + channel - 16 * block;
+        mask[p] = index >= 0 && index < 16 ? (char)index : (char)0x80;
+    }
+    return _mm_loadu_si128((const __m128i *)mask);
+}
+
+__attribute__((target("ssse3"))) static inline __m128i grayWeigh(__m128i b, __m128i g, __m128i r)
+{
+    __m128i y = _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(GRAY_B)), _mm_mullo_epi16(g, _mm_set1_epi16(GRAY_G)));
+    y = _mm_add_epi16(y, _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(GRAY_R)), _mm_set1_epi16(128)));
+    return _mm_srli_epi16(y, 8);
+}
+
+__attribute__((target("ssse3"))) static int grayRowSsse3(unsigned char *dst, const unsigned char *src, int width, int channels)
+{
+    __m128i masks[3][4];
+    for (int c = 0; c < 3; c++)
+        for (int k = 0; k < channels; k++)
+            masks[c][k] = grayPlaneMask(channels, c, k);
+
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        const unsigned char *p = src + x * channels;
+        __m128i planes[3] = {zero, zero, zero};
+        for (int k = 0; k < channels; k++)
+        {
+            __m128i block = _mm_loadu_si128((const __m128i *)(p + 16 * k));
+            for (int c = 0; c < 3; c++)
+                planes[c] = _mm_or_si128(planes[c], _mm_shuffle_epi8(block, masks[c][k]));
+        }
+
+        __m128i lo = grayWeigh(_mm_unpacklo_epi8(planes[0], zero), _mm_unpacklo_epi8(planes[1], zero), _mm_unpacklo_epi8(planes[2], zero));
+        __m128i hi = grayWeigh(_mm_unpackhi_epi8(planes[0], zero), _mm_unpackhi_epi8(planes[1], zero), _mm_unpackhi_epi8(planes[2], zero));
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+    return x;
+}
+
+__attribute__((target("avx2"))) static inline __m256i grayWeigh256(__m256i b, __m256i g, __m256i r)
+{
+    __m256i y = _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(GRAY_B)), _mm256_mullo_epi16(g, _mm256_set1_epi16(GRAY_G)));
+    y = _mm256_add_epi16(y, _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(GRAY_R)), _mm256_set1_epi16(128)));
+    return _mm256_srli_epi16(y, 8);
+}
+
+/**
+ * Same as grayRowSsse3() on 32 pixels at a time: the low and high 128-bit
+ * lanes hold 16 pixels each, since AVX2 shuffles and packs stay within lanes.
+ */
+__attribute__((target("avx2"))) static int grayRowAvx2(unsigned char *dst, const unsigned char *src, int width, int channels)
+{
+    __m256i masks[3][4];
+    for (int c = 0; c < 3; c++)
+        for (int k = 0; k < channels; k++)
+            masks[c][k] = _mm256_broadcastsi128_si256(grayPlaneMask(channels, c, k));
+
+    const __m256i zero = _mm256_setzero_si256();
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        const unsigned char *p = src + x * channels;
+        __m256i planes[3] = {zero, zero, zero};
+        for (int k = 0; k < channels; k++)
+        {
+            __m128i low = _mm_loadu_si128((const __m128i *)(p + 16 * k));
+            __m128i high = _mm_loadu_si128((const __m128i *)(p + 16 * channels + 16 * k));
+            __m256i block = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+            for (int c = 0; c < 3; c++)
+                planes[c] = _mm256_or_si256(planes[c], _mm256_shuffle_epi8(block, masks[c][k]));
+        }
+
+        __m256i lo = grayWeigh256(_mm256_unpacklo_epi8(planes[0], zero), _mm256_unpacklo_epi8(planes[1], zero), _mm256_unpacklo_epi8(planes[2], zero));
+        __m256i hi = grayWeigh256(_mm256_unpackhi_epi8(planes[0], zero), _mm256_unpackhi_epi8(planes[1], zero), _mm256_unpackhi_epi8(planes[2], zero));
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_packus_epi16(lo, hi));
+    }
+    return x;
+}
+#endif
+
+#ifdef GRAY_NEON
+static inline uint8x8_t grayWeighNeon(uint8x8_t b, uint8x8_t g, uint8x8_t r)
+{
+    uint16x8_t y = vmull_u8(b, vdup_n_u8(GRAY_B));
+    y = vmlal_u8(y, g, vdup_n_u8(GRAY_G));
+    y = vmlal_u8(y, r, vdup_n_u8(GRAY_R));
+    return vrshrn_n_u16(y, 8);
+}
+
+static int grayRowNeon(unsigned char *dst, const unsigned char *src, int width, int channels)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16_t b, g, r;
+        if (channels == 3)
+        {
+            uint8x16x3_t pixels = vld3q_u8(src + x * 3);
+            b = pixels.val[0], g = pixels.val[1], r = pixels.val[2];
+        }
+        else
+        {
+            uint8x16x4_t pixels = vld4q_u8(src + x * 4);
+            b = pixels.val[0], g = pixels.val[1], r = pixels.val[2];
+        }
+        uint8x8_t lo = grayWeighNeon(vget_low_u8(b), vget_low_u8(g), vget_low_u8(r));
+        uint8x8_t hi = grayWeighNeon(vget_high_u8(b), vget_high_u8(g), vget_high_u8(r));
+        vst1q_u8(dst + x, vcombine_u8(lo, hi));
+    }
+    return x;
+}
+#endif
+
+/**
+ * Pick the widest gray kernel the CPU supports, or NULL for none.
+ */
+static GrayRowKernel selectGrayKernel()
+{
+#if defined(GRAY_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return grayRowAvx2;
+    if (__builtin_cpu_supports("ssse3"))
+        return grayRowSsse3;
+#elif defined(GRAY_NEON)
+    return grayRowNeon;
+#endif
+    return NULL;
+}
+
+/**
+ * Convert an image to 8-bit gray in a single pass. 8-bit BGR and BGRA rows go
+ * through the vector kernel chosen for the CPU at first use, 16-bit pixels
+ * keep their high byte, and gray images are copied.
+ */
+void convertToGray(unsigned char *dst, int dstStride, const unsigned char *src, int srcStride,
+                   int width, int height, int channels, int itemSize)
+{
+    static const GrayRowKernel kernel = selectGrayKernel();
+    for (int y = 0; y < height; y++)
+    {
+        unsigned char *out = dst + (size_t)y * dstStride;
+        const unsigned char *in = src + (int64_t)y * srcStride;
+        if (itemSize == 2)
+        {
+            for (int x = 0; x < width; x++)
+                out[x] = (unsigned char)sampleLuma(in + (size_t)x * channels * 2, channels, 2);
+        }
+        else if (channels < 3)
+        {
+            for (int x = 0; x < width; x++)
+                out[x] = in[x * channels];
+        }
+        else
+        {
+            int x = kernel ? kernel(out, in, width, channels) : 0;
+            grayRowScalar(out + x, in + (size_t)x * channels, width - x, channels);
+        }
+    }
+}
+
+/**
+ * Shrink an image by an integer factor and convert it to 8-bit gray in the
+ * same pass: each factor x factor block is averaged per channel as in
+ * boxDownscale(), then weighted as in grayRowScalar(). The destination holds
+ * (width / factor) x (height / factor) packed gray pixels.
+ */
+template <typename T>
+static void boxDownscaleGray(const unsigned char *bytes, int width, int height, int stride, int channels,
+                             int factor, unsigned char *dst)
+{
+    int dstWidth = width / factor;
+    int dstHeight = height / factor;
+    int shift = (sizeof(T) - 1) * 8; // 16-bit pixels keep their high byte
+    uint32_t area = (uint32_t)(factor * factor);
+    std::vector<uint32_t> sums(dstWidth * channels);
+    for (int y = 0; y < dstHeight; y++)
+    {
+        std::fill(sums.begin(), sums.end(), 0);
+        for (int r = 0; r < factor; r++)
+        {
+            const T *in = (const T *)(bytes + (int64_t)(y * factor + r) * stride);
+            for (int x = 0; x < dstWidth; x++)
+            {
+                uint32_t *sum = &sums[x * channels];
+                for (int i = 0; i < factor; i++, in += channels)
+                    for (int k = 0; k < channels; k++)
+                        sum[k] += in[k] >> shift;
+            }
+        }
+
+        unsigned char *out = dst + (size_t)y * dstWidth;
+        for (int x = 0; x < dstWidth; x++)
+        {
+            const uint32_t *sum = &sums[x * channels];
+            uint32_t luma = channels < 3 ? sum[0] * 256 : GRAY_B * sum[0] + GRAY_G * sum[1] + GRAY_R * sum[2];
+            out[x] = (unsigned char)((luma / area + 128) >> 8);
+        }
+    }
+}
+
+void downscaleToGray(const unsigned char *bytes, int width, int height, int stride, int channels, int itemSize,
+                     int factor, unsigned char *dst)
+{
+    if (itemSize == 2)
+        boxDownscaleGray<uint16_t>(bytes, width, height, stride, channels, factor, dst);
+    else
+        boxDownscaleGray<unsigned char>(bytes, width, height, stride, channels, factor, dst);
+}
+
+/**
+ * Local contrast normalization in the manner of CLAHE. The image is split
+ * into up to 8 x 8 tiles, each tile's histogram is clipped at clipLimit times
+ * the mean bin count and equalized, and every pixel is mapped through the
+ * curves of its four nearest tiles, blended bilinearly. Faded or unevenly lit
+ * documents come out with even contrast, without amplifying noise in flat
+ * areas. src and dst may be the same buffer.
+ */
+void normalizeContrast(const unsigned char *src, int srcStride, unsigned char *dst, int dstStride,
+                       int width, int height, double clipLimit)
+{
+    const int TILES = 8;
+    int tilesX = width / 16 < TILES ? (width / 16 > 0 ? width / 16 : 1) : TILES;
+    int tilesY = height / 16 < TILES ? (height / 16 > 0 ? height / 16 : 1) : TILES;
+    int tileWidth = (width + tilesX - 1) / tilesX;
+    int tileHeight = (height + tilesY - 1) / tilesY;
+
+    std::vector<unsigned char> luts((size_t)tilesX * tilesY * 256);
+    for (int ty = 0; ty < tilesY; ty++)
+    {
+        for (int tx = 0; tx < tilesX; tx++)
+        {
+            int x0 = tx * tileWidth, x1 = std::min(x0 + tileWidth, width);
+            int y0 = ty * tileHeight, y1 = std::min(y0 + tileHeight, height);
+            int hist[256] = {0};
+            for (int y = y0; y < y1; y++)
+            {
+                const unsigned char *row = src + (int64_t)y * srcStride;
+                for (int x = x0; x < x1; x++)
+                    hist[row[x]]++;
+            }
+
+            int count = (x1 - x0) * (y1 - y0);
+            int clip = (int)(clipLimit * count / 256);
+            clip = clip > 1 ? clip : 1;
+            int excess = 0;
+            for (int i = 0; i < 256; i++)
+            {
+                if (hist[i] > clip)
+                {
+                    excess += hist[i] - clip;
+                    hist[i] = clip;
+                }
+            }
+
+            unsigned char *lut = &luts[((size_t)ty * tilesX + tx) * 256];
+            int cdf = 0;
+            for (int i = 0; i < 256; i++)
+            {
+                cdf += hist[i] + excess / 256 + (i < excess % 256);
+                lut[i] = count > 0 ? (unsigned char)(((int64_t)cdf * 255 + count / 2) / count) : (unsigned char)i;
+            }
+        }
+    }
+
+    // Neighbouring tiles and blend weights (1/256) of every column.
+    std::vector<int> left(width), right(width), weight(width);
+    for (int x = 0; x < width; x++)
+    {
+        double t = (x + 0.5) / tileWidth - 0.5;
+        int t0 = t < 0 ? 0 : (int)t;
+        left[x] = (t0 < tilesX ? t0 : tilesX - 1) * 256;
+        right[x] = (t0 + 1 < tilesX ? t0 + 1 : tilesX - 1) * 256;
+        weight[x] = t < 0 ? 0 : (int)((t - t0) * 256);
+    }
+
+    // The curves of each tile column are blended vertically once per row, in 1/256.
+    std::vector<uint16_t> rowLuts((size_t)tilesX * 256);
+    for (int y = 0; y < height; y++)
+    {
+        double t = (y + 0.5) / tileHeight - 0.5;
+        int t0 = t < 0 ? 0 : (int)t;
+        int top = t0 < tilesY ? t0 : tilesY - 1;
+        int bottom = t0 + 1 < tilesY ? t0 + 1 : tilesY - 1;
+        int wy = t < 0 ? 0 : (int)((t - t0) * 256);
+
+        const unsigned char *topLuts = &luts[(size_t)top * tilesX * 256];
+        const unsigned char *bottomLuts = &luts[(size_t)bottom * tilesX * 256];
+        for (int i = 0; i < tilesX * 256; i++)
+            rowLuts[i] = (uint16_t)(topLuts[i] * (256 - wy) + bottomLuts[i] * wy);
+
+        const unsigned char *in = src + (int64_t)y * srcStride;
+        unsigned char *out = dst + (size_t)y * dstStride;
+        const uint16_t *curves = &rowLuts[0];
+        for (int x = 0; x < width; x++)
+        {
+            int v = in[x], wx = weight[x];
+            out[x] = (unsigned char)((curves[left[x] + v] * (256 - wx) + curves[right[x] + v] * wx + 32768) >> 16);
+        }
+    }
+}
+
+#define THUMBNAIL_SIZE 32
+
+/**
+ * Reduce an image to a THUMBNAIL_SIZE x THUMBNAIL_SIZE luminance thumbnail.
+ * Each cell averages 4 x 4 samples, which smooths out sensor noise.
+ */
+void computeThumbnail(const unsigned char *bytes, int width, int height, int stride, int channels, int itemSize,
+                      unsigned char *thumbnail)
+{
+    const int SAMPLES = 4;
+    const int GRID = THUMBNAIL_SIZE * SAMPLES;
+    int pixelBytes = channels * itemSize;
+    memset(thumbnail, 0, THUMBNAIL_SIZE * THUMBNAIL_SIZE);
+    if (width < 1 || height < 1)
+        return;
+
+    std::vector<int> sums(THUMBNAIL_SIZE * THUMBNAIL_SIZE, 0);
+    for (int r = 0; r < GRID; r++)
+    {
+        const unsigned char *row = bytes + (int64_t)r * height / GRID * stride;
+        int *cells = &sums[r / SAMPLES * THUMBNAIL_SIZE];
+        for (int i = 0; i < GRID; i++)
+        {
+            cells[i / SAMPLES] += sampleLuma(row + (int64_t)i * width / GRID * pixelBytes, channels, itemSize);
+        }
+    }
+
+    for (int i = 0; i < THUMBNAIL_SIZE * THUMBNAIL_SIZE; i++)
+        thumbnail[i] = (unsigned char)(sums[i] / (SAMPLES * SAMPLES));
+}
+
+/**
+ * Mean absolute difference between two thumbnails, in luminance levels.
+ */
+double thumbnailDifference(const unsigned char *a, const unsigned char *b)
+{
+    int sum = 0;
+    for (int i = 0; i < THUMBNAIL_SIZE * THUMBNAIL_SIZE; i++)
+        sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+    return (double)sum / (THUMBNAIL_SIZE * THUMBNAIL_SIZE);
+}
+
+#endif
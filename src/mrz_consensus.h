@@ -0,0 +1,235 @@
+#ifndef __MRZ_CONSENSUS_H__
+#define __MRZ_CONSENSUS_H__
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include "DynamsoftLabelRecognizer.h"
+#include "mrz_parser.h"
+
+#define MRZ_SYMBOLS 37
+
+static const char MRZ_ALPHABET[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ<";
+
+/**
+ * Index of an MRZ character in MRZ_ALPHABET.
+ *
+ * @return the index, or -1 for characters not allowed in an MRZ
+ */
+inline int mrzSymbol(char c)
+{
+    if (c == '<')
+        return MRZ_SYMBOLS - 1;
+    return mrzCharValue(c);
+}
+
+/**
+ * Collect the lines of a recognition result with the candidates of their
+ * characters. Lines without character results get their own text as the only
+ * candidate, weighted by the line confidence.
+ */
+inline void mrzLinesFromResults(DLR_ResultArray *pResults, std::vector<std::string> &lines,
+                                std::vector<std::vector<MrzCandidates> > &candidates)
+{
+    lines.clear();
+    candidates.clear();
+    if (pResults == NULL)
+        return;
+
+    for (int i = 0; i < pResults->resultsCount; i++)
+    {
+        DLR_Result *mrzResult = pResults->results[i];
+        for (int j = 0; j < mrzResult->lineResultsCount; j++)
+        {
+            DLR_LineResult *lineResult = mrzResult->lineResults[j];
+            lines.push_back(lineResult->text);
+            const std::string &text = lines.back();
+
+            candidates.push_back(std::vector<MrzCandidates>(text.size()));
+            std::vector<MrzCandidates> &line = candidates.back();
+            bool characters = lineResult->characterResultsCount == (int)text.size();
+            for (size_t c = 0; c < text.size(); c++)
+            {
+                MrzCandidates &candidate = line[c];
+                if (characters)
+                {
+                    DLR_CharacterResult *character = lineResult->characterResults[c];
+                    candidate.chars[0] = character->characterH;
+                    candidate.chars[1] = character->characterM;
+                    candidate.chars[2] = character->characterL;
+                    candidate.confidences[0] = character->characterHConfidence;
+                    candidate.confidences[1] = character->characterMConfidence;
+                    candidate.confidences[2] = character->characterLConfidence;
+                }
+                else
+                {
+                    candidate.chars[0] = candidate.chars[1] = candidate.chars[2] = text[c];
+                    candidate.confidences[0] = lineResult->confidence;
+                    candidate.confidences[1] = candidate.confidences[2] = 0;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Accumulates the reads of one document over consecutive video frames. The
+ * machine readable zones of the frames are aligned by position, and every
+ * character candidate votes with its confidence. Once the voted lines pass
+ * their check digits and stay the same for the required number of frames,
+ * the consensus is done and no more frames need to be recognized.
+ */
+class MrzConsensus
+{
+public:
+    std::mutex m;
+    std::atomic<int> frames;      // agreeing frames required, 0 disables consensus
+    std::atomic<bool> done;
+    bool correct = true;          // correct the voted lines with mrzCorrect()
+    MrzDocument document;         // the consensus once done
+
+    MrzConsensus() : frames(0), done(false) {}
+
+    bool enabled()
+    {
+        return frames > 0;
+    }
+
+    /**
+     * Forget the current document, e.g. when the next traveller steps up.
+     */
+    void reset()
+    {
+        std::lock_guard<std::mutex> lk(m);
+        layout = NULL;
+        votes.clear();
+        last.clear();
+        stable = 0;
+        document = MrzDocument();
+        done = false;
+    }
+
+    /**
+     * Vote with the lines recognized in a frame. Frames without a machine
+     * readable zone are ignored, and a zone of another format starts over.
+     *
+     * @return true if this frame completes the consensus
+     */
+    bool add(const std::vector<std::string> &lines, const std::vector<std::vector<MrzCandidates> > &candidates)
+    {
+        std::lock_guard<std::mutex> lk(m);
+        if (done)
+            return false;
+
+        std::vector<std::string> zone;
+        size_t start = 0;
+        const MrzLayout *frameLayout = mrzLocate(lines, zone, &start);
+        if (frameLayout == NULL)
+            return false;
+
+        if (frameLayout != layout)
+        {
+            layout = frameLayout;
+            votes.assign(layout->lineCount, std::vector<int>(layout->lineLength * MRZ_SYMBOLS, 0));
+            last.clear();
+            stable = 0;
+        }
+
+        for (int l = 0; l < layout->lineCount; l++)
+        {
+            const std::vector<MrzCandidates> &line = candidates[start + l];
+            for (int c = 0; c < layout->lineLength; c++)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    int symbol = mrzSymbol(line[c].chars[k]);
+                    if (symbol >= 0 && line[c].confidences[k] > 0)
+                        votes[l][c * MRZ_SYMBOLS + symbol] += line[c].confidences[k];
+                }
+            }
+        }
+
+        std::vector<std::string> voted;
+        std::vector<std::vector<MrzCandidates> > runnersUp;
+        vote(voted, runnersUp);
+
+        int corrections = 0;
+        if (correct && mrzFailedChecks(voted, *layout) > 0)
+        {
+            std::vector<const MrzCandidates *> pointers;
+            for (size_t l = 0; l < runnersUp.size(); l++)
+                pointers.push_back(&runnersUp[l][0]);
+            corrections = mrzCorrect(voted, &pointers, *layout);
+        }
+
+        if (mrzFailedChecks(voted, *layout) > 0)
+        {
+            stable = 0;
+            last = voted;
+            return false;
+        }
+
+        stable = voted == last ? stable + 1 : 1;
+        last = voted;
+        if (stable < frames)
+            return false;
+
+        mrzParse(voted, document);
+        document.corrections = corrections;
+        done = true;
+        return true;
+    }
+
+private:
+    const MrzLayout *layout = NULL;
+    std::vector<std::vector<int> > votes; // per line, the score of every symbol at every column
+    std::vector<std::string> last;        // voted lines after the previous frame
+    int stable = 0;                       // frames in a row voting the same valid lines
+
+    /**
+     * Pick the best scoring character of every position, and keep the three
+     * best as candidates, with their share of the votes as confidence.
+     */
+    void vote(std::vector<std::string> &voted, std::vector<std::vector<MrzCandidates> > &runnersUp)
+    {
+        voted.assign(layout->lineCount, std::string(layout->lineLength, '<'));
+        runnersUp.assign(layout->lineCount, std::vector<MrzCandidates>(layout->lineLength));
+        for (int l = 0; l < layout->lineCount; l++)
+        {
+            for (int c = 0; c < layout->lineLength; c++)
+            {
+                const int *scores = &votes[l][c * MRZ_SYMBOLS];
+                int best[3] = {-1, -1, -1};
+                int total = 0;
+                for (int s = 0; s < MRZ_SYMBOLS; s++)
+                {
+                    total += scores[s];
+                    for (int k = 0; k < 3; k++)
+                    {
+                        if (best[k] < 0 || scores[s] > scores[best[k]])
+                        {
+                            for (int j = 2; j > k; j--)
+                                best[j] = best[j - 1];
+                            best[k] = s;
+                            break;
+                        }
+                    }
+                }
+                if (total == 0)
+                    best[0] = MRZ_SYMBOLS - 1;
+
+                voted[l][c] = MRZ_ALPHABET[best[0]];
+                MrzCandidates &candidate = runnersUp[l][c];
+                for (int k = 0; k < 3; k++)
+                {
+                    candidate.chars[k] = MRZ_ALPHABET[best[k]];
+                    candidate.confidences[k] = total > 0 ? scores[best[k]] * 100 / total : 0;
+                }
+            }
+        }
+    }
+};
+
+#endif
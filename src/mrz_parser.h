@@ -0,0 +1,965 @@
+#ifndef __MRZ_PARSER_H__
+#define __MRZ_PARSER_H__
+
+#include <Python.h>
+#include <string.h>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include "mrz_result.h"
+
+/**
+ * Native parser for the machine readable zones of ICAO 9303 travel documents.
+ * The document format is picked from the line count and length, so each
+ * frame is parsed once.
+ */
+
+enum MrzFormat
+{
+    MRZ_UNKNOWN,
+    MRZ_TD1,  // 3 x 30, ID cards
+    MRZ_TD2,  // 2 x 36, ID cards
+    MRZ_TD3,  // 2 x 44, passports
+    MRZ_MRVA, // 2 x 44, visas
+    MRZ_MRVB  // 2 x 36, visas
+};
+
+// A run of characters on one line.
+struct MrzSpan
+{
+    int line;
+    int start;
+    int length;
+};
+
+struct MrzFieldSpec
+{
+    const char *name;
+    MrzSpan span;
+};
+
+// A check digit computed over up to four spans.
+struct MrzCheckSpec
+{
+    const char *name;
+    int spanCount;
+    MrzSpan spans[4];
+    int line;
+    int position;
+    bool numeric; // the spans may only hold digits
+    bool filler;  // the check digit may be '<' when the spans are all fillers
+};
+
+struct MrzLayout
+{
+    int format;
+    const char *type;
+    int lineCount;
+    int lineLength;
+    const MrzFieldSpec *fields;
+    int fieldCount;
+    const MrzCheckSpec *checks;
+    int checkCount;
+};
+
+// The "names" field is split into "surname" and "given_names".
+static const MrzFieldSpec TD1_FIELDS[] = {
+    {"document_type", {0, 0, 2}},
+    {"country", {0, 2, 3}},
+    {"document_number", {0, 5, 9}},
+    {"optional_data", {0, 15, 15}},
+    {"birth_date", {1, 0, 6}},
+    {"sex", {1, 7, 1}},
+    {"expiry_date", {1, 8, 6}},
+    {"nationality", {1, 15, 3}},
+    {"optional_data_2", {1, 18, 11}},
+    {"names", {2, 0, 30}}};
+
+static const MrzCheckSpec TD1_CHECKS[] = {
+    {"document_number", 1, {{0, 5, 9}}, 0, 14},
+    {"birth_date", 1, {{1, 0, 6}}, 1, 6, true},
+    {"expiry_date", 1, {{1, 8, 6}}, 1, 14, true},
+    {"composite", 4, {{0, 5, 25}, {1, 0, 7}, {1, 8, 7}, {1, 18, 11}}, 1, 29}};
+
+static const MrzFieldSpec TD2_FIELDS[] = {
+    {"document_type", {0, 0, 2}},
+    {"country", {0, 2, 3}},
+    {"names", {0, 5, 31}},
+    {"document_number", {1, 0, 9}},
+    {"nationality", {1, 10, 3}},
+    {"birth_date", {1, 13, 6}},
+    {"sex", {1, 20, 1}},
+    {"expiry_date", {1, 21, 6}},
+    {"optional_data", {1, 28, 7}}};
+
+static const MrzCheckSpec TD2_CHECKS[] = {
+    {"document_number", 1, {{1, 0, 9}}, 1, 9},
+    {"birth_date", 1, {{1, 13, 6}}, 1, 19, true},
+    {"expiry_date", 1, {{1, 21, 6}}, 1, 27, true},
+    {"composite", 3, {{1, 0, 10}, {1, 13, 7}, {1, 21, 14}}, 1, 35}};
+
+static const MrzFieldSpec TD3_FIELDS[] = {
+    {"document_type", {0, 0, 2}},
+    {"country", {0, 2, 3}},
+    {"names", {0, 5, 39}},
+    {"document_number", {1, 0, 9}},
+    {"nationality", {1, 10, 3}},
+    {"birth_date", {1, 13, 6}},
+    {"sex", {1, 20, 1}},
+    {"expiry_date", {1, 21, 6}},
+    {"optional_data", {1, 28, 14}}};
+
+static const MrzCheckSpec TD3_CHECKS[] = {
+    {"document_number", 1, {{1, 0, 9}}, 1, 9},
+    {"birth_date", 1, {{1, 13, 6}}, 1, 19, true},
+    {"expiry_date", 1, {{1, 21, 6}}, 1, 27, true},
+    {"optional_data", 1, {{1, 28, 14}}, 1, 42, false, true},
+    {"composite", 3, {{1, 0, 10}, {1, 13, 7}, {1, 21, 22}}, 1, 43}};
+
+static const MrzFieldSpec MRVA_FIELDS[] = {
+    {"document_type", {0, 0, 2}},
+    {"country", {0, 2, 3}},
+    {"names", {0, 5, 39}},
+    {"document_number", {1, 0, 9}},
+    {"nationality", {1, 10, 3}},
+    {"birth_date", {1, 13, 6}},
+    {"sex", {1, 20, 1}},
+    {"expiry_date", {1, 21, 6}},
+    {"optional_data", {1, 28, 16}}};
+
+static const MrzFieldSpec MRVB_FIELDS[] = {
+    {"document_type", {0, 0, 2}},
+    {"country", {0, 2, 3}},
+    {"names", {0, 5, 31}},
+    {"document_number", {1, 0, 9}},
+    {"nationality", {1, 10, 3}},
+    {"birth_date", {1, 13, 6}},
+    {"sex", {1, 20, 1}},
+    {"expiry_date", {1, 21, 6}},
+    {"optional_data", {1, 28, 8}}};
+
+// Visas have no composite check digit.
+static const MrzCheckSpec MRV_CHECKS[] = {
+    {"document_number", 1, {{1, 0, 9}}, 1, 9},
+    {"birth_date", 1, {{1, 13, 6}}, 1, 19, true},
+    {"expiry_date", 1, {{1, 21, 6}}, 1, 27, true}};
+
+#define MRZ_COUNT(array) ((int)(sizeof(array) / sizeof(array[0])))
+
+static const MrzLayout MRZ_LAYOUTS[] = {
+    {MRZ_TD1, "TD1", 3, 30, TD1_FIELDS, MRZ_COUNT(TD1_FIELDS), TD1_CHECKS, MRZ_COUNT(TD1_CHECKS)},
+    {MRZ_TD2, "TD2", 2, 36, TD2_FIELDS, MRZ_COUNT(TD2_FIELDS), TD2_CHECKS, MRZ_COUNT(TD2_CHECKS)},
+    {MRZ_TD3, "TD3", 2, 44, TD3_FIELDS, MRZ_COUNT(TD3_FIELDS), TD3_CHECKS, MRZ_COUNT(TD3_CHECKS)},
+    {MRZ_MRVA, "MRVA", 2, 44, MRVA_FIELDS, MRZ_COUNT(MRVA_FIELDS), MRV_CHECKS, MRZ_COUNT(MRV_CHECKS)},
+    {MRZ_MRVB, "MRVB", 2, 36, MRVB_FIELDS, MRZ_COUNT(MRVB_FIELDS), MRV_CHECKS, MRZ_COUNT(MRV_CHECKS)}};
+
+/**
+ * Value of an MRZ character in check digit computation: 0-9 for digits,
+ * 10-35 for letters and 0 for the filler '<'.
+ *
+ * @return the value, or -1 for characters not allowed in an MRZ
+ */
+inline int mrzCharValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A' + 10;
+    if (c == '<')
+        return 0;
+    return -1;
+}
+
+/**
+ * Weighted sum of a span with the repeating 7-3-1 weights, starting at the
+ * given weight index.
+ *
+ * @return the sum, or -1 if the span holds an invalid character
+ */
+inline int mrzWeightedSum(const char *s, int length, int weightIndex = 0)
+{
+    static const int weights[3] = {7, 3, 1};
+    int sum = 0;
+    for (int i = 0; i < length; i++)
+    {
+        int value = mrzCharValue(s[i]);
+        if (value < 0)
+            return -1;
+        sum += value * weights[(weightIndex + i) % 3];
+    }
+    return sum;
+}
+
+/**
+ * Compute the ICAO 9303 check digit of a string.
+ *
+ * @return 0-9, or -1 if the string holds an invalid character
+ */
+inline int mrzCheckDigit(const char *s, int length)
+{
+    int sum = mrzWeightedSum(s, length);
+    return sum < 0 ? -1 : sum % 10;
+}
+
+/**
+ * Verify one check digit of a document. A filler '<' is only accepted for an
+ * empty optional data field, as ICAO 9303 allows for the personal number of
+ * passports; anywhere else it is a misread digit.
+ */
+inline bool mrzVerifyCheck(const std::vector<std::string> &lines, const MrzCheckSpec &check)
+{
+    int sum = 0;
+    int weightIndex = 0;
+    for (int i = 0; i < check.spanCount; i++)
+    {
+        const MrzSpan &span = check.spans[i];
+        int spanSum = mrzWeightedSum(lines[span.line].c_str() + span.start, span.length, weightIndex);
+        if (spanSum < 0)
+            return false;
+        sum += spanSum;
+        weightIndex += span.length;
+    }
+
+    char digit = lines[check.line][check.position];
+    if (digit == '<')
+    {
+        if (!check.filler)
+            return false;
+        for (int i = 0; i < check.spanCount; i++)
+        {
+            const MrzSpan &span = check.spans[i];
+            const std::string &line = lines[span.line];
+            if (line.find_first_not_of('<', span.start) < (size_t)(span.start + span.length))
+                return false;
+        }
+        return true;
+    }
+    return digit >= '0' && digit <= '9' && digit - '0' == sum % 10;
+}
+
+/**
+ * Pick the layout of a document from its line count and length. Visas are
+ * told apart from TD2/TD3 documents by their 'V' document code.
+ *
+ * @return the layout, or NULL if the lines are not a machine readable zone
+ */
+inline const MrzLayout *mrzFindLayout(const std::vector<std::string> &lines)
+{
+    if (lines.empty())
+        return NULL;
+
+    size_t length = lines[0].size();
+    for (size_t i = 1; i < lines.size(); i++)
+    {
+        if (lines[i].size() != length)
+            return NULL;
+    }
+
+    bool visa = lines[0][0] == 'V';
+    for (int i = 0; i < MRZ_COUNT(MRZ_LAYOUTS); i++)
+    {
+        const MrzLayout &layout = MRZ_LAYOUTS[i];
+        if (layout.lineCount != (int)lines.size() || layout.lineLength != (int)length)
+            continue;
+
+        bool visaLayout = layout.format == MRZ_MRVA || layout.format == MRZ_MRVB;
+        if (layout.format == MRZ_TD1 || visa == visaLayout)
+            return &layout;
+    }
+
+    return NULL;
+}
+
+/**
+ * Find the machine readable zone among recognized lines: the first run of
+ * consecutive lines matching a layout. Lines of other lengths, e.g. text
+ * recognized outside the zone, are skipped.
+ *
+ * @return the layout, or NULL if none is found. The zone lines are stored in
+ *         mrz, and the index of the first one in start.
+ */
+inline const MrzLayout *mrzLocate(const std::vector<std::string> &lines, std::vector<std::string> &mrz, size_t *start = NULL)
+{
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        for (size_t count = 3; count >= 2; count--)
+        {
+            if (i + count > lines.size())
+                continue;
+
+            mrz.assign(lines.begin() + i, lines.begin() + i + count);
+            const MrzLayout *layout = mrzFindLayout(mrz);
+            if (layout)
+            {
+                if (start)
+                    *start = i;
+                return layout;
+            }
+        }
+    }
+
+    mrz.clear();
+    return NULL;
+}
+
+/**
+ * Count the check digits of a document that do not verify.
+ */
+inline int mrzFailedChecks(const std::vector<std::string> &lines, const MrzLayout &layout)
+{
+    int failed = 0;
+    for (int i = 0; i < layout.checkCount; i++)
+    {
+        if (!mrzVerifyCheck(lines, layout.checks[i]))
+            failed++;
+    }
+    return failed;
+}
+
+// Alternative readings of one character, as reported by the recognizer.
+struct MrzCandidates
+{
+    char chars[3];       // characterH, characterM and characterL
+    int confidences[3];
+};
+
+// Cost of swapping a character for a look-alike the recognizer did not report.
+#define MRZ_CONFUSION_COST 60
+
+/**
+ * Look-alike of a character across the digit/letter boundary, e.g. O and 0.
+ *
+ * @return the look-alike, or 0 if there is none
+ */
+inline char mrzConfusion(char c)
+{
+    switch (c)
+    {
+    case 'O':
+    case 'D':
+    case 'Q':
+        return '0';
+    case 'I':
+    case 'L':
+        return '1';
+    case 'Z':
+        return '2';
+    case 'S':
+        return '5';
+    case 'G':
+        return '6';
+    case 'T':
+        return '7';
+    case 'B':
+        return '8';
+    case '0':
+        return 'O';
+    case '1':
+        return 'I';
+    case '2':
+        return 'Z';
+    case '5':
+        return 'S';
+    case '6':
+        return 'G';
+    case '8':
+        return 'B';
+    }
+    return 0;
+}
+
+/**
+ * Candidates of the character at a position, if the recognizer reported them.
+ */
+inline const MrzCandidates *mrzCandidatesAt(const std::vector<const MrzCandidates *> *candidates, int line, int column)
+{
+    if (candidates == NULL || (*candidates)[line] == NULL)
+        return NULL;
+    return (*candidates)[line] + column;
+}
+
+struct MrzOption
+{
+    char c;
+    int cost;
+};
+
+/**
+ * List the characters a position may be corrected to, with the confidence
+ * lost by each. The recognized character costs nothing.
+ */
+inline void mrzOptions(char original, const MrzCandidates *candidates, bool numeric, std::vector<MrzOption> &options)
+{
+    options.clear();
+    char chars[4] = {original};
+    int costs[4] = {0};
+    int count = 1;
+    if (candidates)
+    {
+        for (int k = 1; k < 3; k++)
+        {
+            chars[count] = candidates->chars[k];
+            costs[count++] = std::max(0, candidates->confidences[0] - candidates->confidences[k]);
+        }
+    }
+
+    for (int k = 0; k < count * 2; k++)
+    {
+        char c = k < count ? chars[k] : mrzConfusion(chars[k - count]);
+        int cost = k < count ? costs[k] : costs[k - count] + MRZ_CONFUSION_COST;
+        if (mrzCharValue(c) < 0 || (numeric && (c < '0' || c > '9')))
+            continue;
+
+        bool seen = false;
+        for (size_t i = 0; i < options.size(); i++)
+        {
+            if (options[i].c == c)
+            {
+                options[i].cost = std::min(options[i].cost, cost);
+                seen = true;
+            }
+        }
+        if (!seen)
+        {
+            MrzOption option = {c, cost};
+            options.push_back(option);
+        }
+    }
+}
+
+/**
+ * Whether a position is covered by a check digit other than the composite one,
+ * either as data or as the check digit itself.
+ */
+inline bool mrzCoveredByField(const MrzLayout &layout, int line, int column)
+{
+    for (int i = 0; i < layout.checkCount; i++)
+    {
+        const MrzCheckSpec &check = layout.checks[i];
+        if (strcmp(check.name, "composite") == 0)
+            continue;
+        if (check.line == line && check.position == column)
+            return true;
+        for (int j = 0; j < check.spanCount; j++)
+        {
+            const MrzSpan &span = check.spans[j];
+            if (span.line == line && column >= span.start && column < span.start + span.length)
+                return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Make one check digit verify with the cheapest set of at most maxChanges
+ * substitutions. A dynamic program over the weighted sum modulo 10 finds the
+ * exact optimum in time linear in the field length.
+ *
+ * @param fixed: whether positions covered by other check digits are kept,
+ *        as for the composite check digit
+ *
+ * @return the number of characters changed, or -1 if no correction exists
+ */
+inline int mrzCorrectCheck(std::vector<std::string> &lines, const std::vector<const MrzCandidates *> *candidates,
+                           const MrzLayout &layout, const MrzCheckSpec &check, bool fixed, int maxChanges)
+{
+    static const int weights[3] = {7, 3, 1};
+    const int INF = 1 << 29;
+
+    struct Free
+    {
+        int line, column, weight;
+        std::vector<MrzOption> options;
+    };
+    std::vector<Free> positions;
+    int base = 0;
+    int weightIndex = 0;
+    for (int i = 0; i < check.spanCount; i++)
+    {
+        const MrzSpan &span = check.spans[i];
+        for (int column = span.start; column < span.start + span.length; column++, weightIndex++)
+        {
+            int weight = weights[weightIndex % 3];
+            char c = lines[span.line][column];
+            if (fixed && mrzCoveredByField(layout, span.line, column))
+            {
+                int value = mrzCharValue(c);
+                if (value < 0)
+                    return -1;
+                base += value * weight;
+                continue;
+            }
+
+            Free position = {span.line, column, weight};
+            mrzOptions(c, mrzCandidatesAt(candidates, span.line, column), check.numeric, position.options);
+            if (position.options.empty())
+                return -1;
+            positions.push_back(position);
+        }
+    }
+
+    // The check digit is the last position, weighted so it cancels the sum.
+    Free digit = {check.line, check.position, 0};
+    // A failing '<' check digit is a misread digit, so any digit is a change.
+    char original = lines[check.line][check.position];
+    mrzOptions(original == '<' ? '0' : original, mrzCandidatesAt(candidates, check.line, check.position), true, digit.options);
+    if (digit.options.empty())
+        return -1;
+
+    // cost[i][changes][sum] with the choice made at every step for backtracking.
+    size_t stride = (size_t)(maxChanges + 1) * 10;
+    std::vector<int> cost((positions.size() + 1) * stride, INF);
+    std::vector<signed char> choice(positions.size() * stride, -1);
+    cost[base % 10] = 0;
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        const Free &position = positions[i];
+        char current = lines[position.line][position.column];
+        for (int changes = 0; changes <= maxChanges; changes++)
+        {
+            for (int sum = 0; sum < 10; sum++)
+            {
+                int from = cost[i * stride + changes * 10 + sum];
+                if (from == INF)
+                    continue;
+                for (size_t k = 0; k < position.options.size(); k++)
+                {
+                    const MrzOption &option = position.options[k];
+                    int nextChanges = changes + (option.c != current);
+                    if (nextChanges > maxChanges)
+                        continue;
+                    int nextSum = (sum + mrzCharValue(option.c) * position.weight) % 10;
+                    size_t to = (i + 1) * stride + nextChanges * 10 + nextSum;
+                    if (from + option.cost < cost[to])
+                    {
+                        cost[to] = from + option.cost;
+                        choice[i * stride + nextChanges * 10 + nextSum] = (signed char)(k * 10 + sum);
+                    }
+                }
+            }
+        }
+    }
+
+    int best = INF, bestChanges = -1, bestOption = -1;
+    size_t last = positions.size() * stride;
+    for (int changes = 0; changes <= maxChanges; changes++)
+    {
+        for (size_t k = 0; k < digit.options.size(); k++)
+        {
+            int digitChanges = changes + (digit.options[k].c != original);
+            int sum = digit.options[k].c - '0';
+            if (digitChanges > maxChanges || cost[last + changes * 10 + sum] == INF)
+                continue;
+            int total = cost[last + changes * 10 + sum] + digit.options[k].cost;
+            if (total < best)
+            {
+                best = total;
+                bestChanges = changes;
+                bestOption = (int)k;
+            }
+        }
+    }
+    if (bestOption < 0)
+        return -1;
+
+    int changed = 0;
+    char d = digit.options[bestOption].c;
+    if (d != original)
+    {
+        lines[check.line][check.position] = d;
+        changed++;
+    }
+
+    int changes = bestChanges;
+    int sum = d - '0';
+    for (size_t i = positions.size(); i-- > 0;)
+    {
+        int step = choice[i * stride + changes * 10 + sum];
+        const MrzOption &option = positions[i].options[step / 10];
+        char &c = lines[positions[i].line][positions[i].column];
+        if (option.c != c)
+        {
+            c = option.c;
+            changes--;
+            changed++;
+        }
+        sum = step % 10;
+    }
+
+    return changed;
+}
+
+/**
+ * Correct a document whose check digits fail, using the alternative readings
+ * of every character and look-alike digits and letters. Each failing check
+ * digit gets the substitutions losing the least confidence, at most maxChanges
+ * each, that make it verify; dates only take digits. Field check digits are
+ * corrected first, then the composite one over the remaining positions. The
+ * search is linear in the line length, so it is safe to run on every frame.
+ *
+ * @param candidates: per line, the candidates of every character, or NULL to
+ *        only consider look-alikes
+ *
+ * @return the number of characters changed
+ */
+inline int mrzCorrect(std::vector<std::string> &lines, const std::vector<const MrzCandidates *> *candidates,
+                      const MrzLayout &layout, int maxChanges = 2)
+{
+    int changed = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int i = 0; i < layout.checkCount; i++)
+        {
+            const MrzCheckSpec &check = layout.checks[i];
+            bool composite = strcmp(check.name, "composite") == 0;
+            if (composite != (pass == 1) || mrzVerifyCheck(lines, check))
+                continue;
+
+            int ret = mrzCorrectCheck(lines, candidates, layout, check, composite, maxChanges);
+            if (ret > 0)
+                changed += ret;
+        }
+    }
+    return changed;
+}
+
+/**
+ * Turn a field into text: fillers become spaces, and leading and trailing
+ * fillers are dropped.
+ */
+inline std::string mrzFieldText(const std::string &line, const MrzSpan &span)
+{
+    std::string text = line.substr(span.start, span.length);
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '<')
+            text[i] = ' ';
+    }
+
+    size_t first = text.find_first_not_of(' ');
+    if (first == std::string::npos)
+        return std::string();
+    size_t last = text.find_last_not_of(' ');
+    return text.substr(first, last - first + 1);
+}
+
+struct MrzField
+{
+    const char *name;
+    std::string value;
+};
+
+struct MrzCheck
+{
+    const char *name;
+    bool valid;
+};
+
+class MrzDocument
+{
+public:
+    const MrzLayout *layout = NULL;
+    std::vector<std::string> lines;
+    std::vector<MrzField> fields;
+    std::vector<MrzCheck> checks;
+    int corrections = 0; // characters changed to make the check digits verify
+
+    bool valid() const
+    {
+        for (size_t i = 0; i < checks.size(); i++)
+        {
+            if (!checks[i].valid)
+                return false;
+        }
+        return layout != NULL;
+    }
+};
+
+/**
+ * Parse recognized lines into fields and verify their check digits.
+ *
+ * @param candidates: the candidates of every character of each line, or NULL
+ * @param correct: correct the lines if a check digit fails, see mrzCorrect()
+ *
+ * @return false if no machine readable zone is found
+ */
+inline bool mrzParse(const std::vector<std::string> &lines, MrzDocument &document,
+                     const std::vector<const MrzCandidates *> *candidates = NULL, bool correct = false)
+{
+    size_t start = 0;
+    document.layout = mrzLocate(lines, document.lines, &start);
+    document.fields.clear();
+    document.checks.clear();
+    document.corrections = 0;
+    if (document.layout == NULL)
+        return false;
+
+    const MrzLayout &layout = *document.layout;
+    if (correct && mrzFailedChecks(document.lines, layout) > 0)
+    {
+        std::vector<const MrzCandidates *> zone;
+        if (candidates)
+            zone.assign(candidates->begin() + start, candidates->begin() + start + document.lines.size());
+        document.corrections = mrzCorrect(document.lines, candidates ? &zone : NULL, layout);
+    }
+
+    for (int i = 0; i < layout.fieldCount; i++)
+    {
+        const MrzFieldSpec &spec = layout.fields[i];
+        const std::string &line = document.lines[spec.span.line];
+        if (strcmp(spec.name, "names") != 0)
+        {
+            MrzField field = {spec.name, mrzFieldText(line, spec.span)};
+            document.fields.push_back(field);
+            continue;
+        }
+
+        // The primary identifier is separated from the secondary one by "<<".
+        std::string names = line.substr(spec.span.start, spec.span.length);
+        size_t separator = names.find("<<");
+        MrzSpan surname = {0, spec.span.start, (int)(separator == std::string::npos ? names.size() : separator)};
+        MrzSpan givenNames = {0, surname.start + surname.length, spec.span.length - surname.length};
+        MrzField surnameField = {"surname", mrzFieldText(line, surname)};
+        MrzField givenNamesField = {"given_names", mrzFieldText(line, givenNames)};
+        document.fields.push_back(surnameField);
+        document.fields.push_back(givenNamesField);
+    }
+
+    for (int i = 0; i < layout.checkCount; i++)
+    {
+        MrzCheck check = {layout.checks[i].name, mrzVerifyCheck(document.lines, layout.checks[i])};
+        document.checks.push_back(check);
+    }
+
+    return true;
+}
+
+/**
+ * Get a contiguous buffer of a RESULT_ARRAYS dict entry.
+ *
+ * @return false with a Python exception set on failure
+ */
+static bool getResultArray(PyObject *dict, const char *key, Py_ssize_t itemSize, Py_buffer *view)
+{
+    PyObject *array = PyDict_GetItemString(dict, key);
+    if (array == NULL)
+    {
+        PyErr_Format(PyExc_KeyError, "result arrays have no \"%s\" entry", key);
+        return false;
+    }
+
+    if (PyObject_GetBuffer(array, view, PyBUF_C_CONTIGUOUS) < 0)
+        return false;
+
+    if (view->itemsize != itemSize)
+    {
+        PyErr_Format(PyExc_ValueError, "unexpected item size of \"%s\"", key);
+        PyBuffer_Release(view);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Collect the lines of a RESULT_ARRAYS dict, and the character candidates of
+ * a RESULT_CHARACTERS one. Lines whose characters do not match their text
+ * get no candidates.
+ *
+ * @return false with a Python exception set on failure
+ */
+static bool getMrzArrayLines(PyObject *dict, std::vector<std::string> &lines, std::vector<std::vector<MrzCandidates> > &candidates)
+{
+    PyObject *text = PyDict_GetItemString(dict, "text");
+    if (text == NULL || !PyBytes_Check(text))
+    {
+        PyErr_SetString(PyExc_TypeError, "result arrays must hold \"text\" bytes");
+        return false;
+    }
+
+    Py_buffer offsets;
+    if (!getResultArray(dict, "offsets", 4, &offsets))
+        return false;
+
+    const char *textData = PyBytes_AS_STRING(text);
+    Py_ssize_t textLength = PyBytes_GET_SIZE(text);
+    const int32_t *offsetsData = (const int32_t *)offsets.buf;
+    Py_ssize_t lineCount = offsets.len / 4 - 1;
+    for (Py_ssize_t i = 0; i < lineCount; i++)
+    {
+        int32_t start = offsetsData[i], end = offsetsData[i + 1];
+        if (start < 0 || end < start || end > textLength)
+        {
+            PyErr_SetString(PyExc_ValueError, "result offsets are out of range");
+            PyBuffer_Release(&offsets);
+            return false;
+        }
+        lines.push_back(std::string(textData + start, end - start));
+    }
+    PyBuffer_Release(&offsets);
+
+    candidates.assign(lines.size(), std::vector<MrzCandidates>());
+    if (PyDict_GetItemString(dict, "characters") == NULL)
+        return true;
+
+    Py_buffer chars, confidences, charOffsets;
+    if (!getResultArray(dict, "characters", 1, &chars))
+        return false;
+    if (!getResultArray(dict, "character_confidences", 4, &confidences))
+    {
+        PyBuffer_Release(&chars);
+        return false;
+    }
+    if (!getResultArray(dict, "character_offsets", 4, &charOffsets))
+    {
+        PyBuffer_Release(&chars);
+        PyBuffer_Release(&confidences);
+        return false;
+    }
+
+    const char *charsData = (const char *)chars.buf;
+    const int32_t *confidencesData = (const int32_t *)confidences.buf;
+    const int32_t *charOffsetsData = (const int32_t *)charOffsets.buf;
+    Py_ssize_t charCount = std::min(chars.len / 3, confidences.len / 12);
+    for (size_t i = 0; i < lines.size() && (Py_ssize_t)i + 1 < charOffsets.len / 4; i++)
+    {
+        int32_t start = charOffsetsData[i], end = charOffsetsData[i + 1];
+        if (start < 0 || end > charCount || end - start != (int32_t)lines[i].size())
+            continue;
+
+        candidates[i].resize(end - start);
+        for (int32_t c = start; c < end; c++)
+        {
+            MrzCandidates &candidate = candidates[i][c - start];
+            for (int k = 0; k < 3; k++)
+            {
+                candidate.chars[k] = charsData[c * 3 + k];
+                candidate.confidences[k] = confidencesData[c * 3 + k];
+            }
+        }
+    }
+
+    PyBuffer_Release(&chars);
+    PyBuffer_Release(&confidences);
+    PyBuffer_Release(&charOffsets);
+    return true;
+}
+
+/**
+ * Collect the lines to parse from a string holding one line per row, from a
+ * sequence of strings or MrzResult objects such as the output of decodeMat(),
+ * or from the dict of a RESULT_ARRAYS or RESULT_CHARACTERS decode.
+ *
+ * @param candidates: filled with the character candidates of each line, which
+ *        are only known for RESULT_CHARACTERS
+ *
+ * @return false with a Python exception set on failure
+ */
+static bool getMrzLines(PyObject *o, std::vector<std::string> &lines, std::vector<std::vector<MrzCandidates> > &candidates)
+{
+    if (PyDict_Check(o))
+        return getMrzArrayLines(o, lines, candidates);
+
+    if (PyUnicode_Check(o))
+    {
+        const char *text = PyUnicode_AsUTF8(o);
+        if (text == NULL)
+            return false;
+
+        while (true)
+        {
+            const char *end = strchr(text, '\n');
+            std::string line = end ? std::string(text, end - text) : std::string(text);
+            size_t first = line.find_first_not_of(" \r\t");
+            if (first != std::string::npos)
+                lines.push_back(line.substr(first, line.find_last_not_of(" \r\t") - first + 1));
+            if (end == NULL)
+                return true;
+            text = end + 1;
+        }
+    }
+
+    PyObject *seq = PySequence_Fast(o, "argument must be a string or a sequence of lines");
+    if (seq == NULL)
+        return false;
+
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+    for (Py_ssize_t i = 0; i < count; i++)
+    {
+        PyObject *item = PySequence_Fast_GET_ITEM(seq, i);
+        const char *text;
+        if (Py_TYPE(item) == &MrzResultType)
+            text = MrzResult_text((MrzResult *)item);
+        else
+            text = PyUnicode_Check(item) ? PyUnicode_AsUTF8(item) : NULL;
+        if (text == NULL)
+        {
+            if (!PyErr_Occurred())
+                PyErr_SetString(PyExc_TypeError, "lines must be strings or MrzResult objects");
+            Py_DECREF(seq);
+            return false;
+        }
+        lines.push_back(text);
+    }
+
+    Py_DECREF(seq);
+    return true;
+}
+
+/**
+ * Convert a parsed document to a dict holding "type", "valid", the fields,
+ * "checks" mapping every check digit to whether it verifies, the zone "lines"
+ * and the number of "corrections" made to them.
+ */
+static PyObject *createPyDocument(const MrzDocument &document)
+{
+    PyObject *lines = PyList_New(document.lines.size());
+    if (lines == NULL)
+        return NULL;
+    for (size_t i = 0; i < document.lines.size(); i++)
+    {
+        PyObject *line = PyUnicode_FromStringAndSize(document.lines[i].c_str(), document.lines[i].size());
+        if (line == NULL)
+        {
+            Py_DECREF(lines);
+            return NULL;
+        }
+        PyList_SET_ITEM(lines, i, line);
+    }
+
+    PyObject *dict = Py_BuildValue("{s:s,s:O,s:N,s:i}", "type", document.layout->type,
+                                   "valid", document.valid() ? Py_True : Py_False,
+                                   "lines", lines, "corrections", document.corrections);
+    PyObject *checks = PyDict_New();
+    if (dict == NULL || checks == NULL)
+    {
+        Py_XDECREF(dict);
+        Py_XDECREF(checks);
+        return NULL;
+    }
+
+    bool ok = PyDict_SetItemString(dict, "checks", checks) == 0;
+    Py_DECREF(checks);
+
+    for (size_t i = 0; ok && i < document.fields.size(); i++)
+    {
+        PyObject *value = PyUnicode_FromStringAndSize(document.fields[i].value.c_str(), document.fields[i].value.size());
+        ok = value && PyDict_SetItemString(dict, document.fields[i].name, value) == 0;
+        Py_XDECREF(value);
+    }
+
+    for (size_t i = 0; ok && i < document.checks.size(); i++)
+    {
+        ok = PyDict_SetItemString(checks, document.checks[i].name, document.checks[i].valid ? Py_True : Py_False) == 0;
+    }
+
+    if (!ok)
+    {
+        Py_DECREF(dict);
+        return NULL;
+    }
+
+    return dict;
+}
+
+#endif
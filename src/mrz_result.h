@@ -3,35 +3,24 @@
 
 #include <Python.h>
 #include <structmember.h>
+#include <string.h>
 
 // https://docs.python.org/3/c-api/typeobj.html#typedef-examples
+// Results are stored as C fields in a single allocation, with the text inline.
+// Python objects are only created when an attribute is read.
+// Attributes stay writable, as they were when they were stored as objects.
 typedef struct 
 {
-	PyObject_HEAD
-    PyObject *confidence;
-	PyObject *text;
-	PyObject *x1;
-	PyObject *y1;
-	PyObject *x2;
-	PyObject *y2;
-	PyObject *x3;
-	PyObject *y3;
-	PyObject *x4;
-	PyObject *y4;
+	PyObject_VAR_HEAD
+	int confidence;
+	int points[8]; // x1, y1, x2, y2, x3, y3, x4, y4
+	PyObject *assignedText; // str assigned to text, which may not fit inline
+	char text[1];
 } MrzResult;
 
 static void MrzResult_dealloc(MrzResult *self)
 {
-	if (self->confidence) Py_DECREF(self->confidence);
-    if (self->text) Py_DECREF(self->text);
-    if (self->x1) Py_DECREF(self->x1);
-    if (self->y1) Py_DECREF(self->y1);
-    if (self->x2) Py_DECREF(self->x2);
-    if (self->y2) Py_DECREF(self->y2);
-    if (self->x3) Py_DECREF(self->x3);
-    if (self->y3) Py_DECREF(self->y3);
-    if (self->x4) Py_DECREF(self->x4);
-    if (self->y4) Py_DECREF(self->y4);
+    Py_XDECREF(self->assignedText);
     Py_TYPE(self)->tp_free((PyObject *)self);
 }
 
@@ -43,24 +32,93 @@ static PyObject *MrzResult_new(PyTypeObject *type, PyObject *args, PyObject *kwd
     return (PyObject *)self;
 }
 
-static PyMemberDef MrzResult_members[] = {
-    {"confidence", T_OBJECT_EX, offsetof(MrzResult, confidence), 0, "confidence"},
-    {"text", T_OBJECT_EX, offsetof(MrzResult, text), 0, "text"},
-    {"x1", T_OBJECT_EX, offsetof(MrzResult, x1), 0, "x1"},
-    {"y1", T_OBJECT_EX, offsetof(MrzResult, y1), 0, "y1"},
-    {"x2", T_OBJECT_EX, offsetof(MrzResult, x2), 0, "x2"},
-    {"y2", T_OBJECT_EX, offsetof(MrzResult, y2), 0, "y2"},
-    {"x3", T_OBJECT_EX, offsetof(MrzResult, x3), 0, "x3"},
-    {"y3", T_OBJECT_EX, offsetof(MrzResult, y3), 0, "y3"},
-    {"x4", T_OBJECT_EX, offsetof(MrzResult, x4), 0, "x4"},
-    {"y4", T_OBJECT_EX, offsetof(MrzResult, y4), 0, "y4"},
+static PyObject *MrzResult_getConfidence(MrzResult *self, void *closure)
+{
+    return PyLong_FromLong(self->confidence);
+}
+
+static PyObject *MrzResult_getText(MrzResult *self, void *closure)
+{
+    if (self->assignedText)
+    {
+        Py_INCREF(self->assignedText);
+        return self->assignedText;
+    }
+    return PyUnicode_FromString(self->text);
+}
+
+static PyObject *MrzResult_getPoint(MrzResult *self, void *closure)
+{
+    return PyLong_FromLong(self->points[(Py_intptr_t)closure]);
+}
+
+/**
+ * Store an int attribute. Attributes cannot be deleted.
+ */
+static int MrzResult_setInt(int *field, PyObject *value)
+{
+    if (value == NULL)
+    {
+        PyErr_SetString(PyExc_TypeError, "cannot delete MrzResult attributes");
+        return -1;
+    }
+
+    long number = PyLong_AsLong(value);
+    if (number == -1 && PyErr_Occurred())
+        return -1;
+    *field = (int)number;
+    return 0;
+}
+
+static int MrzResult_setConfidence(MrzResult *self, PyObject *value, void *closure)
+{
+    return MrzResult_setInt(&self->confidence, value);
+}
+
+static int MrzResult_setPoint(MrzResult *self, PyObject *value, void *closure)
+{
+    return MrzResult_setInt(&self->points[(Py_intptr_t)closure], value);
+}
+
+static int MrzResult_setText(MrzResult *self, PyObject *value, void *closure)
+{
+    if (value == NULL || !PyUnicode_Check(value))
+    {
+        PyErr_SetString(PyExc_TypeError, "text must be a str");
+        return -1;
+    }
+
+    Py_INCREF(value);
+    Py_XSETREF(self->assignedText, value);
+    return 0;
+}
+
+/**
+ * The text of a result, as a UTF-8 string owned by the result.
+ */
+static const char *MrzResult_text(MrzResult *self)
+{
+    return self->assignedText ? PyUnicode_AsUTF8(self->assignedText) : self->text;
+}
+
+static PyGetSetDef MrzResult_getset[] = {
+    {"confidence", (getter)MrzResult_getConfidence, (setter)MrzResult_setConfidence, "confidence", NULL},
+    {"text", (getter)MrzResult_getText, (setter)MrzResult_setText, "text", NULL},
+    {"x1", (getter)MrzResult_getPoint, (setter)MrzResult_setPoint, "x1", (void *)0},
+    {"y1", (getter)MrzResult_getPoint, (setter)MrzResult_setPoint, "y1", (void *)1},
+    {"x2", (getter)MrzResult_getPoint, (setter)MrzResult_setPoint, "x2", (void *)2},
+    {"y2", (getter)MrzResult_getPoint, (setter)MrzResult_setPoint, "y2", (void *)3},
+    {"x3", (getter)MrzResult_getPoint, (setter)MrzResult_setPoint, "x3", (void *)4},
+    {"y3", (getter)MrzResult_getPoint, (setter)MrzResult_setPoint, "y3", (void *)5},
+    {"x4", (getter)MrzResult_getPoint, (setter)MrzResult_setPoint, "x4", (void *)6},
+    {"y4", (getter)MrzResult_getPoint, (setter)MrzResult_setPoint, "y4", (void *)7},
     {NULL}  /* Sentinel */
 };
 
 static PyTypeObject MrzResultType = {
     PyVarObject_HEAD_INIT(NULL, 0) "mrzscanner.MrzResult", /* tp_name */
     sizeof(MrzResult),                                       /* tp_basicsize */
-    0,                                                           /* tp_itemsize */
+    1,                                                           /* tp_itemsize */
     (destructor)MrzResult_dealloc,                           /* tp_dealloc */
     0,                                                           /* tp_print */
     0,                                                           /* tp_getattr */
@@ -85,8 +143,8 @@ static PyTypeObject MrzResultType = {
     0,                                                           /* tp_iter */
     0,                                                           /* tp_iternext */
     0,                                                           /* tp_methods */
-    MrzResult_members,                                       /* tp_members */
-    0,                                                           /* tp_getset */
+    0,                                                           /* tp_members */
+    MrzResult_getset,                                        /* tp_getset */
     0,                                                           /* tp_base */
     0,                                                           /* tp_dict */
     0,                                                           /* tp_descr_get */
@@ -97,4 +155,21 @@ static PyTypeObject MrzResultType = {
     MrzResult_new,                                           /* tp_new */
 };
 
+/**
+ * Create a result for one recognized line.
+ */
+static PyObject *MrzResult_create(const char *text, int confidence, const int points[8])
+{
+    size_t length = strlen(text);
+    MrzResult *self = PyObject_NewVar(MrzResult, &MrzResultType, length);
+    if (self == NULL)
+        return NULL;
+
+    self->confidence = confidence;
+    self->assignedText = NULL;
+    memcpy(self->points, points, sizeof(self->points));
+    memcpy(self->text, text, length + 1);
+    return (PyObject *)self;
+}
+
 #endif
\ No newline at end of file
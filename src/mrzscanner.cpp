@@ -5,6 +5,8 @@
 #include <stdio.h>
 
 #include "dynamsoft_mrz_reader.h"
+#include "reader_pool.h"
+#include "mrz_parser.h"
 
 #define INITERROR return NULL
 
@@ -41,11 +43,15 @@ static PyObject *createInstance(PyObject *obj, PyObject *args)
     if (PyType_Ready(&DynamsoftMrzReaderType) < 0)
         INITERROR;
 
-    DynamsoftMrzReader *reader = PyObject_New(DynamsoftMrzReader, &DynamsoftMrzReaderType);
-    reader->handler = DLR_CreateInstance();
-    reader->worker = NULL;
-    reader->callback = NULL;
-    return (PyObject *)reader;
+    return DynamsoftMrzReader_new(&DynamsoftMrzReaderType, NULL, NULL);
+}
+
+static PyObject *createReaderPool(PyObject *obj, PyObject *args)
+{
+    if (PyType_Ready(&ReaderPoolType) < 0)
+        INITERROR;
+
+    return PyObject_CallObject((PyObject *)&ReaderPoolType, args);
 }
 
 static PyObject *initLicense(PyObject *obj, PyObject *args)
@@ -64,9 +70,51 @@ static PyObject *initLicense(PyObject *obj, PyObject *args)
     return Py_BuildValue("i", ret);
 }
 
+/**
+ * Parse the machine readable zone of a travel document and verify its check
+ * digits. The format (TD1, TD2, TD3, MRVA or MRVB) is picked from the line
+ * count and length.
+ *
+ * @param lines: a string with one line per row, a list of strings or
+ *        MrzResult objects such as the output of decodeMat(), or the dict of a
+ *        RESULT_ARRAYS or RESULT_CHARACTERS decode
+ * @param bool correct: if a check digit fails, correct the lines with the
+ *        alternative character candidates of a RESULT_CHARACTERS decode and
+ *        look-alike digits and letters. Defaults to False.
+ *
+ * @return dict of fields, or None if no machine readable zone is found
+ */
+static PyObject *parse(PyObject *obj, PyObject *args)
+{
+    PyObject *o;
+    int correct = 0;
+    if (!PyArg_ParseTuple(args, "O|p", &o, &correct))
+        return NULL;
+
+    std::vector<std::string> lines;
+    std::vector<std::vector<MrzCandidates> > candidates;
+    if (!getMrzLines(o, lines, candidates))
+        return NULL;
+
+    std::vector<const MrzCandidates *> lineCandidates(lines.size(), (const MrzCandidates *)NULL);
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        if (!candidates[i].empty())
+            lineCandidates[i] = &candidates[i][0];
+    }
+
+    MrzDocument document;
+    if (!mrzParse(lines, document, &lineCandidates, correct != 0))
+        Py_RETURN_NONE;
+
+    return createPyDocument(document);
+}
+
 static PyMethodDef mrzscanner_methods[] = {
     {"initLicense", initLicense, METH_VARARGS, "Set license to activate the SDK"},
     {"createInstance", createInstance, METH_VARARGS, "Create Dynamsoft MRZ Reader object"},
+    {"createReaderPool", createReaderPool, METH_VARARGS, "Create a pool of Dynamsoft MRZ Readers"},
+    {"parse", parse, METH_VARARGS, "Parse MRZ lines and verify their check digits"},
     {NULL, NULL, 0, NULL}};
 
 static struct PyModuleDef mrzscanner_module_def = {
@@ -96,6 +144,26 @@ PyMODINIT_FUNC PyInit_mrzscanner(void)
     Py_INCREF(&MrzResultType);
     PyModule_AddObject(module, "MrzResult", (PyObject *)&MrzResultType);
 
+    if (PyType_Ready(&ReaderPoolType) < 0)
+        INITERROR;
+
+    Py_INCREF(&ReaderPoolType);
+    PyModule_AddObject(module, "ReaderPool", (PyObject *)&ReaderPoolType);
+
+    PyModule_AddIntConstant(module, "YUV_NV21", YUV_NV21);
+    PyModule_AddIntConstant(module, "YUV_NV12", YUV_NV12);
+    PyModule_AddIntConstant(module, "YUV_I420", YUV_I420);
+    PyModule_AddIntConstant(module, "YUV_YUYV", YUV_YUYV);
+
+    PyModule_AddIntConstant(module, "QUEUE_DROP_OLDEST", QUEUE_DROP_OLDEST);
+    PyModule_AddIntConstant(module, "QUEUE_DROP_NEWEST", QUEUE_DROP_NEWEST);
+    PyModule_AddIntConstant(module, "QUEUE_BLOCK", QUEUE_BLOCK);
+    PyModule_AddIntConstant(module, "QUEUE_REJECT", QUEUE_REJECT);
+
+    PyModule_AddIntConstant(module, "RESULT_OBJECTS", RESULT_OBJECTS);
+    PyModule_AddIntConstant(module, "RESULT_ARRAYS", RESULT_ARRAYS);
+    PyModule_AddIntConstant(module, "RESULT_CHARACTERS", RESULT_CHARACTERS);
+
     PyModule_AddStringConstant(module, "version", DLR_GetVersion());
     return module;
 }
@@ -0,0 +1,180 @@
+#ifndef __READER_POOL_H__
+#define __READER_POOL_H__
+
+#include <Python.h>
+#include <structmember.h>
+#include "DynamsoftLabelRecognizer.h"
+#include "dynamsoft_mrz_reader.h"
+#include "work_stealing_pool.h"
+
+typedef struct
+{
+    PyObject_HEAD WorkStealingPool *pool;
+} ReaderPool;
+
+static int ReaderPool_clear(ReaderPool *self)
+{
+    if (self->pool)
+    {
+        destroyWorkStealingPool(self->pool);
+        self->pool = NULL;
+    }
+
+    return 0;
+}
+
+static void ReaderPool_dealloc(ReaderPool *self)
+{
+    ReaderPool_clear(self);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *ReaderPool_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    int count = 0;
+    if (!PyArg_ParseTuple(args, "|i", &count))
+    {
+        return NULL;
+    }
+
+    ReaderPool *self = (ReaderPool *)type->tp_alloc(type, 0);
+    if (self != NULL)
+    {
+        self->pool = createWorkStealingPool(count);
+    }
+
+    return (PyObject *)self;
+}
+
+/**
+ * Load MRZ configuration file into every recognizer of the pool.
+ *
+ * @param string template content
+ *
+ * @return loading status
+ */
+static PyObject *ReaderPool_loadModel(PyObject *obj, PyObject *args)
+{
+    ReaderPool *self = (ReaderPool *)obj;
+
+    char *settings;
+    if (!PyArg_ParseTuple(args, "s", &settings))
+    {
+        return NULL;
+    }
+
+    char errorMsgBuffer[512];
+    int ret = self->pool->loadSettings(settings, errorMsgBuffer, 512);
+    printf("Load MRZ model: %s\n", errorMsgBuffer);
+
+    return Py_BuildValue("i", ret);
+}
+
+/**
+ * Queue an OpenCV Mat on the pool. The image is not copied, so it must not be
+ * modified until the future is done.
+ *
+ * @param Mat image
+ *
+ * @return a future resolving to a MrzResult list: an asyncio future when
+ *         called from a running event loop, a concurrent.futures.Future otherwise
+ */
+static PyObject *ReaderPool_submit(PyObject *obj, PyObject *args)
+{
+    ReaderPool *self = (ReaderPool *)obj;
+
+    PyObject *o;
+    if (!PyArg_ParseTuple(args, "O", &o))
+        return NULL;
+
+    PyObject *future = createFuture();
+    if (future == NULL)
+        return NULL;
+
+    PoolTask *task = new PoolTask();
+    task->owner = getImageData(o, &task->data);
+    if (task->owner == NULL)
+    {
+        delete task;
+        Py_DECREF(future);
+        return NULL;
+    }
+
+    Py_INCREF(future);
+    task->future = future;
+    self->pool->push(task);
+
+    return future;
+}
+
+/**
+ * Recognize a list of OpenCV Mats across all recognizers of the pool.
+ *
+ * @param list of Mat images
+ *
+ * @return a list holding one MrzResult list per image, in input order
+ */
+static PyObject *ReaderPool_map(PyObject *obj, PyObject *args)
+{
+    ReaderPool *self = (ReaderPool *)obj;
+
+    PyObject *o;
+    if (!PyArg_ParseTuple(args, "O", &o))
+        return NULL;
+
+    PyObject *seq = PySequence_Fast(o, "argument must be a sequence of images");
+    if (seq == NULL)
+        return NULL;
+
+    PyObject *list = mapImages(self->pool, seq);
+    Py_DECREF(seq);
+    return list;
+}
+
+static PyMethodDef pool_methods[] = {
+    {"loadModel", ReaderPool_loadModel, METH_VARARGS, NULL},
+    {"submit", ReaderPool_submit, METH_VARARGS, NULL},
+    {"map", ReaderPool_map, METH_VARARGS, NULL},
+    {NULL, NULL, 0, NULL}};
+
+static PyTypeObject ReaderPoolType = {
+    PyVarObject_HEAD_INIT(NULL, 0) "mrzscanner.ReaderPool", /* tp_name */
+    sizeof(ReaderPool),                                     /* tp_basicsize */
+    0,                                                      /* tp_itemsize */
+    (destructor)ReaderPool_dealloc,                         /* tp_dealloc */
+    0,                                                      /* tp_print */
+    0,                                                      /* tp_getattr */
+    0,                                                      /* tp_setattr */
+    0,                                                      /* tp_reserved */
+    0,                                                      /* tp_repr */
+    0,                                                      /* tp_as_number */
+    0,                                                      /* tp_as_sequence */
+    0,                                                      /* tp_as_mapping */
+    0,                                                      /* tp_hash  */
+    0,                                                      /* tp_call */
+    0,                                                      /* tp_str */
+    PyObject_GenericGetAttr,                                /* tp_getattro */
+    PyObject_GenericSetAttr,                                /* tp_setattro */
+    0,                                                      /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,               /*tp_flags*/
+    "ReaderPool",                                           /* tp_doc */
+    0,                                                      /* tp_traverse */
+    0,                                                      /* tp_clear */
+    0,                                                      /* tp_richcompare */
+    0,                                                      /* tp_weaklistoffset */
+    0,                                                      /* tp_iter */
+    0,                                                      /* tp_iternext */
+    pool_methods,                                           /* tp_methods */
+    0,                                                      /* tp_members */
+    0,                                                      /* tp_getset */
+    0,                                                      /* tp_base */
+    0,                                                      /* tp_dict */
+    0,                                                      /* tp_descr_get */
+    0,                                                      /* tp_descr_set */
+    0,                                                      /* tp_dictoffset */
+    0,                                                      /* tp_init */
+    0,                                                      /* tp_alloc */
+    ReaderPool_new,                                         /* tp_new */
+};
+
+#endif
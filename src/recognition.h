@@ -0,0 +1,1134 @@
+#ifndef __RECOGNITION_H__
+#define __RECOGNITION_H__
+
+#include <Python.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "DynamsoftLabelRecognizer.h"
+#include "mrz_result.h"
+#include "image_processing.h"
+#include "mrz_parser.h"
+
+PyObject *createPyList(DLR_ResultArray *pResults)
+{
+    int count = pResults->resultsCount;
+    Py_ssize_t lineCount = 0;
+    for (int i = 0; i < count; i++)
+    {
+        lineCount += pResults->results[i]->lineResultsCount;
+    }
+
+    // Create a Python object to store results
+    PyObject *list = PyList_New(lineCount);
+    if (list == NULL)
+        return NULL;
+    Py_ssize_t index = 0;
+    for (int i = 0; i < count; i++)
+    {
+        DLR_Result *mrzResult = pResults->results[i];
+        int lCount = mrzResult->lineResultsCount;
+        for (int j = 0; j < lCount; j++)
+        {
+            // printf("Line result %d: %s\n", j, mrzResult->lineResults[j]->text);
+
+            DLR_LineResult *line = mrzResult->lineResults[j];
+            DM_Point *points = line->location.points;
+            int coordinates[8];
+            for (int k = 0; k < 4; k++)
+            {
+                coordinates[k * 2] = points[k].x;
+                coordinates[k * 2 + 1] = points[k].y;
+            }
+
+            PyObject *result = MrzResult_create(line->text, line->confidence, coordinates);
+            if (result == NULL)
+            {
+                Py_DECREF(list);
+                return NULL;
+            }
+            PyList_SET_ITEM(list, index++, result);
+        }
+    }
+
+    return list;
+}
+
+// How recognized lines are returned to Python.
+enum ResultFormat
+{
+    RESULT_OBJECTS,   // a list of MrzResult
+    RESULT_ARRAYS,    // numpy arrays of quads and confidences, and a packed text buffer
+    RESULT_CHARACTERS // RESULT_ARRAYS plus per-character candidates
+};
+
+/**
+ * A numpy array being filled from native code.
+ */
+class NativeArray
+{
+public:
+    PyObject *array = NULL;
+    Py_buffer view;
+
+    /**
+     * Create a C-contiguous array and expose its memory for writing. Consumes
+     * the shape reference.
+     */
+    bool create(PyObject *numpy, PyObject *shape, const char *dtype)
+    {
+        if (shape == NULL)
+            return false;
+
+        array = PyObject_CallMethod(numpy, "empty", "Os", shape, dtype);
+        Py_DECREF(shape);
+        if (array == NULL)
+            return false;
+
+        if (PyObject_GetBuffer(array, &view, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) < 0)
+        {
+            Py_CLEAR(array);
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * Release the buffer and hand the array reference over to the caller.
+     */
+    PyObject *detach()
+    {
+        if (array)
+            PyBuffer_Release(&view);
+        PyObject *ret = array;
+        array = NULL;
+        return ret;
+    }
+
+    ~NativeArray()
+    {
+        Py_XDECREF(detach());
+    }
+};
+
+/**
+ * Convert results to arrays in a single pass, with no per-line Python object.
+ *
+ * @param bool characters: also return the candidates of every character
+ *
+ * @return dict with "quads" (N, 4, 2) int32, "confidences" (N,) int32, "text"
+ *         bytes holding all lines back to back, and "offsets" (N + 1,) int32 so
+ *         that line i is text[offsets[i]:offsets[i + 1]].
+ *
+ *         With characters, the M characters of all lines are added:
+ *         "characters" (M, 3) uint8 holding characterH/M/L,
+ *         "character_confidences" (M, 3) int32, "character_quads" (M, 4, 2)
+ *         int32, and "character_offsets" (N + 1,) int32 indexing them by line.
+ */
+PyObject *createPyArrays(DLR_ResultArray *pResults, bool characters = false)
+{
+    int count = pResults ? pResults->resultsCount : 0;
+    Py_ssize_t lineCount = 0;
+    Py_ssize_t textLength = 0;
+    Py_ssize_t characterCount = 0;
+    for (int i = 0; i < count; i++)
+    {
+        DLR_Result *mrzResult = pResults->results[i];
+        lineCount += mrzResult->lineResultsCount;
+        for (int j = 0; j < mrzResult->lineResultsCount; j++)
+        {
+            textLength += strlen(mrzResult->lineResults[j]->text);
+            characterCount += mrzResult->lineResults[j]->characterResultsCount;
+        }
+    }
+
+    PyObject *numpy = PyImport_ImportModule("numpy");
+    if (numpy == NULL)
+        return NULL;
+
+    NativeArray quads, confidences, offsets;
+    NativeArray chars, charConfidences, charQuads, charOffsets;
+    bool ok = quads.create(numpy, Py_BuildValue("(nii)", lineCount, 4, 2), "int32") &&
+              confidences.create(numpy, Py_BuildValue("(n)", lineCount), "int32") &&
+              offsets.create(numpy, Py_BuildValue("(n)", lineCount + 1), "int32");
+    if (ok && characters)
+    {
+        ok = chars.create(numpy, Py_BuildValue("(ni)", characterCount, 3), "uint8") &&
+             charConfidences.create(numpy, Py_BuildValue("(ni)", characterCount, 3), "int32") &&
+             charQuads.create(numpy, Py_BuildValue("(nii)", characterCount, 4, 2), "int32") &&
+             charOffsets.create(numpy, Py_BuildValue("(n)", lineCount + 1), "int32");
+    }
+    Py_DECREF(numpy);
+    if (!ok)
+        return NULL;
+
+    PyObject *text = PyBytes_FromStringAndSize(NULL, textLength);
+    if (text == NULL)
+        return NULL;
+
+    int32_t *quadsData = (int32_t *)quads.view.buf;
+    int32_t *confidencesData = (int32_t *)confidences.view.buf;
+    int32_t *offsetsData = (int32_t *)offsets.view.buf;
+    char *textData = PyBytes_AS_STRING(text);
+
+    Py_ssize_t line = 0;
+    int32_t offset = 0;
+    int32_t charOffset = 0;
+    for (int i = 0; i < count; i++)
+    {
+        DLR_Result *mrzResult = pResults->results[i];
+        for (int j = 0; j < mrzResult->lineResultsCount; j++)
+        {
+            DLR_LineResult *lineResult = mrzResult->lineResults[j];
+            for (int k = 0; k < 4; k++)
+            {
+                quadsData[line * 8 + k * 2] = lineResult->location.points[k].x;
+                quadsData[line * 8 + k * 2 + 1] = lineResult->location.points[k].y;
+            }
+            confidencesData[line] = lineResult->confidence;
+
+            size_t length = strlen(lineResult->text);
+            memcpy(textData + offset, lineResult->text, length);
+            offsetsData[line] = offset;
+            offset += (int32_t)length;
+
+            if (characters)
+            {
+                unsigned char *charsData = (unsigned char *)chars.view.buf;
+                int32_t *charConfidencesData = (int32_t *)charConfidences.view.buf;
+                int32_t *charQuadsData = (int32_t *)charQuads.view.buf;
+                ((int32_t *)charOffsets.view.buf)[line] = charOffset;
+                for (int c = 0; c < lineResult->characterResultsCount; c++, charOffset++)
+                {
+                    DLR_CharacterResult *character = lineResult->characterResults[c];
+                    charsData[charOffset * 3] = (unsigned char)character->characterH;
+                    charsData[charOffset * 3 + 1] = (unsigned char)character->characterM;
+                    charsData[charOffset * 3 + 2] = (unsigned char)character->characterL;
+                    charConfidencesData[charOffset * 3] = character->characterHConfidence;
+                    charConfidencesData[charOffset * 3 + 1] = character->characterMConfidence;
+                    charConfidencesData[charOffset * 3 + 2] = character->characterLConfidence;
+                    for (int k = 0; k < 4; k++)
+                    {
+                        charQuadsData[charOffset * 8 + k * 2] = character->location.points[k].x;
+                        charQuadsData[charOffset * 8 + k * 2 + 1] = character->location.points[k].y;
+                    }
+                }
+            }
+            line++;
+        }
+    }
+    offsetsData[line] = offset;
+
+    PyObject *dict = Py_BuildValue("{s:N,s:N,s:N,s:N}",
+                                   "quads", quads.detach(),
+                                   "confidences", confidences.detach(),
+                                   "text", text,
+                                   "offsets", offsets.detach());
+    if (dict == NULL || !characters)
+        return dict;
+
+    ((int32_t *)charOffsets.view.buf)[line] = charOffset;
+    const char *keys[] = {"characters", "character_confidences", "character_quads", "character_offsets"};
+    NativeArray *arrays[] = {&chars, &charConfidences, &charQuads, &charOffsets};
+    for (int i = 0; i < 4; i++)
+    {
+        PyObject *array = arrays[i]->detach();
+        int ret = PyDict_SetItemString(dict, keys[i], array);
+        Py_DECREF(array);
+        if (ret < 0)
+        {
+            Py_DECREF(dict);
+            return NULL;
+        }
+    }
+
+    return dict;
+}
+
+/**
+ * Convert results to Python and release them.
+ *
+ * @param int format: RESULT_OBJECTS, RESULT_ARRAYS or RESULT_CHARACTERS
+ */
+static PyObject *createPyResults(DLR_ResultArray *pResults, int format = RESULT_OBJECTS)
+{
+    if (format == RESULT_ARRAYS || format == RESULT_CHARACTERS)
+    {
+        PyObject *arrays = createPyArrays(pResults, format == RESULT_CHARACTERS);
+        if (pResults)
+            DLR_FreeResults(&pResults);
+        return arrays;
+    }
+
+    if (!pResults)
+    {
+        return NULL;
+    }
+
+    PyObject *list = createPyList(pResults);
+
+    // Release memory
+    DLR_FreeResults(&pResults);
+
+    return list;
+}
+
+int getPixelBytes(ImagePixelFormat format)
+{
+    switch (format)
+    {
+    case IPF_GRAYSCALED:
+        return 1;
+    case IPF_RGB_888:
+    case IPF_BGR_888:
+        return 3;
+    case IPF_ARGB_8888:
+    case IPF_ABGR_8888:
+        return 4;
+    case IPF_RGB_161616:
+        return 6;
+    case IPF_ARGB_16161616:
+    case IPF_ABGR_16161616:
+        return 8;
+    default:
+        return 1;
+    }
+}
+
+/**
+ * Recognize a buffer and fetch its results. Does not touch any Python object,
+ * so it can be called with the GIL released.
+ */
+DLR_ResultArray *recognizeBuffer(void *handler, ImageData *data)
+{
+    int ret = DLR_RecognizeByBuffer(handler, data, "locr");
+    if (ret)
+    {
+        printf("Detection error: %s\n", DLR_GetErrorString(ret));
+    }
+
+    DLR_ResultArray *pResults = NULL;
+    DLR_GetAllResults(handler, &pResults);
+    return pResults;
+}
+
+// Optional stages run around recognition, shared by decodeMat() and decodeMatAsync().
+class PipelineSettings
+{
+public:
+    std::atomic<bool> locateBand;      // recognize only the MRZ band found by locateTextBand()
+    std::atomic<double> minSharpness; // async frames scoring lower are skipped, 0 disables the gate
+    std::atomic<bool> autoRotate;      // turn images upright as estimated by estimateOrientation()
+    std::atomic<int> stripHeight;      // recognize skewed MRZ regions in a rectified strip this high, 0 disables
+    std::atomic<int> pyramidFactor;    // try an image shrunk by this factor first, 0 or 1 disables
+    std::atomic<bool> grayscale;       // pass color images to the recognizer as gray
+    std::atomic<double> contrastClip;  // clip limit of normalizeContrast(), 0 disables it
+
+    PipelineSettings()
+        : locateBand(false), minSharpness(0), autoRotate(false), stripHeight(0), pyramidFactor(0),
+          grayscale(false), contrastClip(0) {}
+};
+
+/**
+ * Split a pixel format into channels and bytes per channel.
+ */
+void getPixelLayout(ImagePixelFormat format, int *channels, int *itemSize)
+{
+    *itemSize = format == IPF_RGB_161616 || format == IPF_ARGB_16161616 || format == IPF_ABGR_16161616 ? 2 : 1;
+    *channels = getPixelBytes(format) / *itemSize;
+}
+
+/**
+ * Focus measure of an image, see measureSharpness().
+ */
+double getSharpness(const ImageData *data)
+{
+    int channels, itemSize;
+    getPixelLayout(data->format, &channels, &itemSize);
+    return measureSharpness(data->bytes, data->width, data->height, data->stride, channels, itemSize);
+}
+
+/**
+ * Clockwise rotation that makes an image upright, see estimateOrientation().
+ */
+int getOrientation(const ImageData *data)
+{
+    int channels, itemSize;
+    getPixelLayout(data->format, &channels, &itemSize);
+    return estimateOrientation(data->bytes, data->width, data->height, data->stride, channels, itemSize);
+}
+
+/**
+ * Whether results hold at least one line.
+ */
+bool hasLines(DLR_ResultArray *pResults)
+{
+    if (pResults == NULL)
+        return false;
+
+    for (int i = 0; i < pResults->resultsCount; i++)
+    {
+        if (pResults->results[i]->lineResultsCount > 0)
+            return true;
+    }
+    return false;
+}
+
+void offsetQuad(Quadrilateral &quad, int dx, int dy)
+{
+    for (int k = 0; k < 4; k++)
+    {
+        quad.points[k].x += dx;
+        quad.points[k].y += dy;
+    }
+}
+
+/**
+ * Shift results recognized in a crop back to the coordinates of the image.
+ */
+void offsetResults(DLR_ResultArray *pResults, int dx, int dy)
+{
+    for (int i = 0; i < pResults->resultsCount; i++)
+    {
+        DLR_Result *mrzResult = pResults->results[i];
+        offsetQuad(mrzResult->location, dx, dy);
+        for (int j = 0; j < mrzResult->lineResultsCount; j++)
+        {
+            DLR_LineResult *lineResult = mrzResult->lineResults[j];
+            offsetQuad(lineResult->location, dx, dy);
+            for (int c = 0; c < lineResult->characterResultsCount; c++)
+            {
+                offsetQuad(lineResult->characterResults[c]->location, dx, dy);
+            }
+        }
+    }
+}
+
+/**
+ * Whether results hold a line as long as an MRZ line of any document format.
+ */
+bool hasMrzLines(DLR_ResultArray *pResults)
+{
+    if (pResults == NULL)
+        return false;
+
+    for (int i = 0; i < pResults->resultsCount; i++)
+    {
+        DLR_Result *mrzResult = pResults->results[i];
+        for (int j = 0; j < mrzResult->lineResultsCount; j++)
+        {
+            size_t length = strlen(mrzResult->lineResults[j]->text);
+            for (int k = 0; k < MRZ_COUNT(MRZ_LAYOUTS); k++)
+            {
+                if (length == (size_t)MRZ_LAYOUTS[k].lineLength)
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Whether results hold a machine readable zone that passes its check digits.
+ */
+bool hasValidMrz(DLR_ResultArray *pResults)
+{
+    if (pResults == NULL)
+        return false;
+
+    std::vector<std::string> lines, zone;
+    for (int i = 0; i < pResults->resultsCount; i++)
+    {
+        DLR_Result *mrzResult = pResults->results[i];
+        for (int j = 0; j < mrzResult->lineResultsCount; j++)
+            lines.push_back(mrzResult->lineResults[j]->text);
+    }
+    const MrzLayout *layout = mrzLocate(lines, zone);
+    return layout != NULL && mrzFailedChecks(zone, *layout) == 0;
+}
+
+/**
+ * Map a quad found in an image rotated clockwise by angle back to the
+ * original image of width x height pixels.
+ */
+void unrotateQuad(Quadrilateral &quad, int angle, int width, int height)
+{
+    for (int k = 0; k < 4; k++)
+    {
+        int x = quad.points[k].x;
+        int y = quad.points[k].y;
+        if (angle == 90)
+        {
+            quad.points[k].x = y;
+            quad.points[k].y = height - 1 - x;
+        }
+        else if (angle == 180)
+        {
+            quad.points[k].x = width - 1 - x;
+            quad.points[k].y = height - 1 - y;
+        }
+        else if (angle == 270)
+        {
+            quad.points[k].x = width - 1 - y;
+            quad.points[k].y = x;
+        }
+    }
+}
+
+/**
+ * Map results recognized in a rotated image back to the original image.
+ */
+void unrotateResults(DLR_ResultArray *pResults, int angle, int width, int height)
+{
+    for (int i = 0; i < pResults->resultsCount; i++)
+    {
+        DLR_Result *mrzResult = pResults->results[i];
+        unrotateQuad(mrzResult->location, angle, width, height);
+        for (int j = 0; j < mrzResult->lineResultsCount; j++)
+        {
+            DLR_LineResult *lineResult = mrzResult->lineResults[j];
+            unrotateQuad(lineResult->location, angle, width, height);
+            for (int c = 0; c < lineResult->characterResultsCount; c++)
+            {
+                unrotateQuad(lineResult->characterResults[c]->location, angle, width, height);
+            }
+        }
+    }
+}
+
+/**
+ * Describe a rectangle of an image without copying it.
+ */
+ImageData cropImageData(const ImageData *data, const int rect[4])
+{
+    int pixelBytes = getPixelBytes(data->format);
+    ImageData crop = *data;
+    crop.bytes = data->bytes + (size_t)rect[1] * data->stride + (size_t)rect[0] * pixelBytes;
+    crop.width = rect[2];
+    crop.height = rect[3];
+    crop.bytesLength = data->stride * (rect[3] - 1) + rect[2] * pixelBytes;
+    return crop;
+}
+
+/**
+ * Recognize the MRZ band of an image, so the recognizer does not search the
+ * whole frame. The band is passed as a zero-copy crop, which works like a
+ * manual reference region without touching the runtime settings shared by
+ * other calls. The whole image is recognized if no band is found or the band
+ * does not hold a valid MRZ, and its results are kept unless they are worse.
+ */
+DLR_ResultArray *recognizeBand(void *handler, ImageData *data)
+{
+    int channels, itemSize;
+    getPixelLayout(data->format, &channels, &itemSize);
+    int rect[4];
+    if (!locateTextBand(data->bytes, data->width, data->height, data->stride, channels, itemSize, rect))
+        return recognizeBuffer(handler, data);
+
+    ImageData crop = cropImageData(data, rect);
+    DLR_ResultArray *pResults = recognizeBuffer(handler, &crop);
+    if (pResults)
+        offsetResults(pResults, rect[0], rect[1]);
+    if (hasValidMrz(pResults))
+        return pResults;
+
+    DLR_ResultArray *pWhole = recognizeBuffer(handler, data);
+    if (hasValidMrz(pWhole) || (!hasLines(pResults) && hasLines(pWhole)))
+    {
+        if (pResults)
+            DLR_FreeResults(&pResults);
+        return pWhole;
+    }
+
+    if (pWhole)
+        DLR_FreeResults(&pWhole);
+    return pResults;
+}
+
+/**
+ * Recognize an image turned clockwise by angle, in its MRZ band if locate is
+ * set. The rotated copy is made in one pass, and result coordinates refer to
+ * the original image.
+ */
+DLR_ResultArray *recognizeOriented(void *handler, ImageData *data, int angle, bool locate)
+{
+    if (angle <= 0)
+        return locate ? recognizeBand(handler, data) : recognizeBuffer(handler, data);
+
+    // Recognition runs without the GIL, so an allocation failure falls back to the image as is.
+    int pixelBytes = getPixelBytes(data->format);
+    unsigned char *buffer = (unsigned char *)malloc((size_t)data->width * data->height * pixelBytes);
+    if (buffer == NULL)
+        return locate ? recognizeBand(handler, data) : recognizeBuffer(handler, data);
+    rotateImage(data->bytes, data->width, data->height, data->stride, pixelBytes, angle, buffer);
+
+    ImageData rotated = *data;
+    rotated.bytes = buffer;
+    rotated.width = angle == 180 ? data->width : data->height;
+    rotated.height = angle == 180 ? data->height : data->width;
+    rotated.stride = rotated.width * pixelBytes;
+    rotated.bytesLength = rotated.stride * rotated.height;
+
+    DLR_ResultArray *pResults = locate ? recognizeBand(handler, &rotated) : recognizeBuffer(handler, &rotated);
+    free(buffer);
+    if (pResults)
+        unrotateResults(pResults, angle, data->width, data->height);
+    return pResults;
+}
+
+/**
+ * Recognize an image in the orientation chosen by the pipeline settings.
+ *
+ * With auto rotation, the image is recognized once in the orientation given by
+ * estimateOrientation(). Only if that read returns MRZ-length lines that fail
+ * their check digits is the image recognized again upside down, in case the
+ * side was misjudged: an upside-down MRZ is still read as lines of garbled
+ * characters, while a frame without a document is not worth a second pass.
+ *
+ * @param orientation receives the rotation of the returned results, or NULL
+ */
+DLR_ResultArray *recognizeUpright(void *handler, ImageData *data, PipelineSettings *pipeline, int *orientation)
+{
+    bool locate = pipeline->locateBand;
+    int angle = pipeline->autoRotate ? getOrientation(data) : -1;
+    if (orientation)
+        *orientation = 0;
+    if (angle < 0)
+        return recognizeOriented(handler, data, 0, locate);
+
+    DLR_ResultArray *pResults = recognizeOriented(handler, data, angle, locate);
+    if (hasValidMrz(pResults) || !hasMrzLines(pResults))
+    {
+        if (orientation)
+            *orientation = angle;
+        return pResults;
+    }
+
+    int flipped = (angle + 180) % 360;
+    DLR_ResultArray *pFlipped = recognizeOriented(handler, data, flipped, locate);
+    if (hasValidMrz(pFlipped))
+    {
+        if (pResults)
+            DLR_FreeResults(&pResults);
+        if (orientation)
+            *orientation = flipped;
+        return pFlipped;
+    }
+
+    if (pFlipped)
+        DLR_FreeResults(&pFlipped);
+    if (orientation)
+        *orientation = angle;
+    return pResults;
+}
+
+/**
+ * The first stage of the pipeline: optionally reduce color images to gray, so
+ * the recognizer, which only uses intensity, gets a third of the bytes, and
+ * normalize the local contrast of the gray image.
+ *
+ * @param prepared receives the image to recognize, a copy of data if neither
+ *                 step is enabled or the buffer cannot be allocated
+ *
+ * @return the buffer holding the prepared pixels, to be freed with free(), or
+ *         NULL
+ */
+unsigned char *prepareFrame(const ImageData *data, PipelineSettings *pipeline, ImageData *prepared)
+{
+    *prepared = *data;
+    double clip = pipeline->contrastClip;
+    bool gray = pipeline->grayscale && data->format != IPF_GRAYSCALED;
+    if (!gray && clip <= 0)
+        return NULL;
+
+    unsigned char *buffer = (unsigned char *)malloc((size_t)data->width * data->height);
+    if (buffer == NULL)
+        return NULL;
+    prepared->format = IPF_GRAYSCALED;
+    prepared->stride = data->width;
+    prepared->bytesLength = data->width * data->height;
+    prepared->bytes = buffer;
+
+    const unsigned char *source = data->bytes;
+    int sourceStride = data->stride;
+    if (data->format != IPF_GRAYSCALED)
+    {
+        int channels, itemSize;
+        getPixelLayout(data->format, &channels, &itemSize);
+        convertToGray(buffer, prepared->stride, data->bytes, data->stride, data->width, data->height, channels, itemSize);
+        source = buffer;
+        sourceStride = prepared->stride;
+    }
+    if (clip > 0)
+        normalizeContrast(source, sourceStride, buffer, prepared->stride, data->width, data->height, clip);
+    return buffer;
+}
+
+// Padding of a rectified quad, relative to its width and height.
+#define STRIP_PAD_X 0.05
+#define STRIP_PAD_Y 0.35
+
+/**
+ * Corners of the MRZ found in results: the location of the result with the
+ * most lines.
+ *
+ * @return false if results hold no line
+ */
+bool getMrzQuad(DLR_ResultArray *pResults, double quad[8])
+{
+    DLR_Result *best = NULL;
+    for (int i = 0; pResults && i < pResults->resultsCount; i++)
+    {
+        DLR_Result *mrzResult = pResults->results[i];
+        if (mrzResult->lineResultsCount > 0 && (best == NULL || mrzResult->lineResultsCount > best->lineResultsCount))
+            best = mrzResult;
+    }
+    if (best == NULL)
+        return false;
+
+    for (int k = 0; k < 4; k++)
+    {
+        quad[k * 2] = best->location.points[k].x;
+        quad[k * 2 + 1] = best->location.points[k].y;
+    }
+    return true;
+}
+
+void unwarpQuad(Quadrilateral &quad, const QuadStrip &strip)
+{
+    for (int k = 0; k < 4; k++)
+    {
+        double x, y;
+        strip.toImage(quad.points[k].x, quad.points[k].y, x, y);
+        quad.points[k].x = (int)floor(x + 0.5);
+        quad.points[k].y = (int)floor(y + 0.5);
+    }
+}
+
+/**
+ * Map results recognized in a rectified strip back to the image.
+ */
+void unwarpResults(DLR_ResultArray *pResults, const QuadStrip &strip)
+{
+    for (int i = 0; i < pResults->resultsCount; i++)
+    {
+        DLR_Result *mrzResult = pResults->results[i];
+        unwarpQuad(mrzResult->location, strip);
+        for (int j = 0; j < mrzResult->lineResultsCount; j++)
+        {
+            DLR_LineResult *lineResult = mrzResult->lineResults[j];
+            unwarpQuad(lineResult->location, strip);
+            for (int c = 0; c < lineResult->characterResultsCount; c++)
+            {
+                unwarpQuad(lineResult->characterResults[c]->location, strip);
+            }
+        }
+    }
+}
+
+/**
+ * Recognize only the MRZ quad of an image, warped into an axis-aligned strip
+ * of the given height. Skew and perspective are removed before recognition,
+ * and the recognizer gets a small input. Result coordinates refer to the
+ * image.
+ *
+ * @param pipeline settings whose gray and contrast stage runs on the strip,
+ *                 or NULL if data is already prepared
+ *
+ * @return the results, or NULL if the quad is degenerate. If the strip cannot
+ *         be allocated, the image is recognized as is.
+ */
+DLR_ResultArray *recognizeRectified(void *handler, ImageData *data, const double quad[8], int stripHeight,
+                                    PipelineSettings *pipeline = NULL)
+{
+    QuadStrip strip(quad, stripHeight, STRIP_PAD_X, STRIP_PAD_Y);
+    if (strip.width == 0 || strip.width > 4 * (data->width + data->height))
+        return NULL;
+
+    int channels, itemSize;
+    getPixelLayout(data->format, &channels, &itemSize);
+    int pixelBytes = channels * itemSize;
+    unsigned char *buffer = (unsigned char *)malloc((size_t)strip.width * strip.height * pixelBytes);
+    if (buffer == NULL)
+        return recognizeBuffer(handler, data);
+    warpQuad(data->bytes, data->width, data->height, data->stride, channels, itemSize, strip, buffer);
+
+    ImageData rectified = *data;
+    rectified.bytes = buffer;
+    rectified.width = strip.width;
+    rectified.height = strip.height;
+    rectified.stride = strip.width * pixelBytes;
+    rectified.bytesLength = rectified.stride * rectified.height;
+
+    ImageData prepared = rectified;
+    unsigned char *preparedBuffer = pipeline ? prepareFrame(&rectified, pipeline, &prepared) : NULL;
+    DLR_ResultArray *pResults = recognizeBuffer(handler, &prepared);
+    free(preparedBuffer);
+    free(buffer);
+    if (pResults)
+        unwarpResults(pResults, strip);
+    return pResults;
+}
+
+/**
+ * Recognize an image at one resolution through the enabled pipeline stages.
+ *
+ * With rectification, a read that fails its check digits, as skewed phone
+ * photos often do, is retried once in a rectified strip of its MRZ quad.
+ *
+ * @param orientation receives the rotation of the returned results, or NULL
+ */
+DLR_ResultArray *recognizeLevel(void *handler, ImageData *data, PipelineSettings *pipeline, int *orientation)
+{
+    DLR_ResultArray *pResults = recognizeUpright(handler, data, pipeline, orientation);
+    int stripHeight = pipeline->stripHeight;
+    double quad[8];
+    if (stripHeight <= 0 || hasValidMrz(pResults) || !getMrzQuad(pResults, quad))
+        return pResults;
+
+    DLR_ResultArray *pRectified = recognizeRectified(handler, data, quad, stripHeight);
+    if (hasValidMrz(pRectified))
+    {
+        DLR_FreeResults(&pResults);
+        return pRectified;
+    }
+
+    if (pRectified)
+        DLR_FreeResults(&pRectified);
+    return pResults;
+}
+
+// Smallest side of a pyramid level worth recognizing.
+#define PYRAMID_MIN_SIZE 64
+
+void scaleQuad(Quadrilateral &quad, int factor)
+{
+    for (int k = 0; k < 4; k++)
+    {
+        quad.points[k].x = quad.points[k].x * factor + factor / 2;
+        quad.points[k].y = quad.points[k].y * factor + factor / 2;
+    }
+}
+
+/**
+ * Map results recognized in an image shrunk by factor back to the image.
+ */
+void scaleResults(DLR_ResultArray *pResults, int factor)
+{
+    for (int i = 0; i < pResults->resultsCount; i++)
+    {
+        DLR_Result *mrzResult = pResults->results[i];
+        scaleQuad(mrzResult->location, factor);
+        for (int j = 0; j < mrzResult->lineResultsCount; j++)
+        {
+            DLR_LineResult *lineResult = mrzResult->lineResults[j];
+            scaleQuad(lineResult->location, factor);
+            for (int c = 0; c < lineResult->characterResultsCount; c++)
+            {
+                scaleQuad(lineResult->characterResults[c]->location, factor);
+            }
+        }
+    }
+}
+
+/**
+ * Recognize an image, trying a lower resolution first in pyramid mode.
+ *
+ * In pyramid mode, the image is first shrunk by the pyramid factor with a box
+ * filter and recognized at that resolution. Large scans usually hold an MRZ
+ * big enough to be read there, at a fraction of the cost. The full resolution
+ * is recognized only if the small image yields no MRZ that passes its check
+ * digits.
+ *
+ * @param orientation receives the rotation of the returned results, or NULL
+ */
+DLR_ResultArray *recognizePyramid(void *handler, ImageData *data, PipelineSettings *pipeline, int *orientation)
+{
+    int factor = pipeline->pyramidFactor;
+    if (factor > 1 && data->width / factor >= PYRAMID_MIN_SIZE && data->height / factor >= PYRAMID_MIN_SIZE)
+    {
+        int channels, itemSize;
+        getPixelLayout(data->format, &channels, &itemSize);
+        int pixelBytes = channels * itemSize;
+
+        ImageData small = *data;
+        small.width = data->width / factor;
+        small.height = data->height / factor;
+        small.stride = small.width * pixelBytes;
+        small.bytesLength = small.stride * small.height;
+        // Without memory for the small level, only the full resolution is recognized.
+        unsigned char *buffer = (unsigned char *)malloc(small.bytesLength);
+        if (buffer)
+        {
+            downscaleImage(data->bytes, data->width, data->height, data->stride, channels, itemSize, factor, buffer);
+            small.bytes = buffer;
+
+            DLR_ResultArray *pResults = recognizeLevel(handler, &small, pipeline, orientation);
+            free(buffer);
+            if (hasValidMrz(pResults))
+            {
+                scaleResults(pResults, factor);
+                return pResults;
+            }
+            if (pResults)
+                DLR_FreeResults(&pResults);
+        }
+    }
+
+    return recognizeLevel(handler, data, pipeline, orientation);
+}
+
+/**
+ * Recognize an image through the enabled pipeline stages. Does not touch any
+ * Python object.
+ *
+ * @param orientation receives the rotation of the returned results, or NULL
+ */
+DLR_ResultArray *recognizeFrame(void *handler, ImageData *data, PipelineSettings *pipeline, int *orientation = NULL)
+{
+    ImageData prepared;
+    unsigned char *buffer = prepareFrame(data, pipeline, &prepared);
+    DLR_ResultArray *pResults = recognizePyramid(handler, &prepared, pipeline, orientation);
+    free(buffer);
+    return pResults;
+}
+
+/**
+ * Follows the MRZ across the frames of a video stream. After a confident read,
+ * the next frame is recognized only in a padded region around the lines found,
+ * since a document held in front of a camera moves little between frames.
+ */
+class RoiTracker
+{
+public:
+    std::mutex m;
+    bool enabled = false;
+    int minConfidence = 60; // lowest line confidence that keeps the region
+    bool valid = false;     // a region is being tracked
+    int rect[4];
+    int width = 0; // size of the frame the region belongs to
+    int height = 0;
+    int angle = 0; // rotation that made the tracked lines upright
+    double quad[8]; // corners of the tracked MRZ, see getMrzQuad()
+
+    std::atomic<size_t> tracked; // frames recognized in the tracked region only
+    std::atomic<size_t> lost;    // frames where the region failed and the whole frame was searched
+
+    RoiTracker() : tracked(0), lost(0) {}
+
+    /**
+     * Track the region of the lines in results, or stop tracking if there is
+     * no confident line.
+     */
+    void update(DLR_ResultArray *pResults, int frameWidth, int frameHeight, int frameAngle)
+    {
+        valid = false;
+        if (!hasLines(pResults))
+            return;
+
+        int x0 = frameWidth, y0 = frameHeight, x1 = 0, y1 = 0;
+        for (int i = 0; i < pResults->resultsCount; i++)
+        {
+            DLR_Result *mrzResult = pResults->results[i];
+            for (int j = 0; j < mrzResult->lineResultsCount; j++)
+            {
+                DLR_LineResult *lineResult = mrzResult->lineResults[j];
+                if (lineResult->confidence < minConfidence)
+                    return;
+                for (int k = 0; k < 4; k++)
+                {
+                    DM_Point &point = lineResult->location.points[k];
+                    x0 = point.x < x0 ? point.x : x0;
+                    y0 = point.y < y0 ? point.y : y0;
+                    x1 = point.x > x1 ? point.x : x1;
+                    y1 = point.y > y1 ? point.y : y1;
+                }
+            }
+        }
+
+        // Leave room for the document to move by half the height of the lines.
+        int pad = (y1 - y0) / 2 + 8;
+        x0 = x0 - pad > 0 ? x0 - pad : 0;
+        y0 = y0 - pad > 0 ? y0 - pad : 0;
+        x1 = x1 + pad < frameWidth ? x1 + pad : frameWidth;
+        y1 = y1 + pad < frameHeight ? y1 + pad : frameHeight;
+        if (x1 <= x0 || y1 <= y0)
+            return;
+
+        rect[0] = x0;
+        rect[1] = y0;
+        rect[2] = x1 - x0;
+        rect[3] = y1 - y0;
+        width = frameWidth;
+        height = frameHeight;
+        angle = frameAngle;
+        getMrzQuad(pResults, quad);
+        valid = true;
+    }
+};
+
+/**
+ * Recognize a video frame, in the tracked region if there is one. The whole
+ * frame is searched when tracking is off, when nothing is tracked, or when
+ * the region yields no line or a line below the tracker's confidence.
+ *
+ * The tracked region goes through the same gray and contrast stage as whole
+ * frames, applied to the cropped region or the rectified strip only, so
+ * tracking keeps its savings.
+ */
+DLR_ResultArray *recognizeTracked(void *handler, ImageData *data, PipelineSettings *pipeline, RoiTracker *tracker)
+{
+    // The lock is not held while recognizing, so setRoiTracking() never waits for a frame.
+    bool enabled, tracking;
+    int rect[4], angle;
+    double quad[8];
+    {
+        std::lock_guard<std::mutex> lk(tracker->m);
+        enabled = tracker->enabled;
+        tracking = enabled && tracker->valid && tracker->width == data->width && tracker->height == data->height;
+        memcpy(rect, tracker->rect, sizeof(rect));
+        angle = tracker->angle;
+        memcpy(quad, tracker->quad, sizeof(quad));
+    }
+    if (!enabled)
+        return recognizeFrame(handler, data, pipeline);
+
+    if (tracking)
+    {
+        // With rectification, the tracked MRZ quad is warped into a strip instead of cropped.
+        DLR_ResultArray *pResults;
+        int stripHeight = pipeline->stripHeight;
+        if (stripHeight > 0)
+        {
+            pResults = recognizeRectified(handler, data, quad, stripHeight, pipeline);
+        }
+        else
+        {
+            ImageData crop = cropImageData(data, rect);
+            ImageData prepared;
+            unsigned char *buffer = prepareFrame(&crop, pipeline, &prepared);
+            pResults = recognizeOriented(handler, &prepared, angle, false);
+            free(buffer);
+            if (hasLines(pResults))
+                offsetResults(pResults, rect[0], rect[1]);
+        }
+
+        std::unique_lock<std::mutex> lk(tracker->m);
+        tracker->update(pResults, data->width, data->height, angle);
+        if (tracker->valid)
+        {
+            tracker->tracked++;
+            return pResults;
+        }
+        lk.unlock();
+
+        tracker->lost++;
+        if (pResults)
+            DLR_FreeResults(&pResults);
+    }
+
+    DLR_ResultArray *pResults = recognizeFrame(handler, data, pipeline, &angle);
+    std::lock_guard<std::mutex> lk(tracker->m);
+    tracker->update(pResults, data->width, data->height, angle);
+    return pResults;
+}
+
+
+/**
+ * Describe an OpenCV Mat as ImageData.
+ *
+ * 8-bit gray, BGR and BGRA images and 16-bit 3- or 4-channel images are passed
+ * to the SDK without a copy, including cropped views whose rows are not
+ * adjacent. Other strided views, and 16-bit gray images, for which the SDK has
+ * no pixel format, are copied into a packed buffer.
+ *
+ * @param Mat image
+ *
+ * @return an object keeping the image bytes alive (a memoryview of the image,
+ *         or a copy), or NULL on failure
+ */
+PyObject *getImageData(PyObject *o, ImageData *data)
+{
+    PyObject *memoryview = PyMemoryView_FromObject(o);
+    if (memoryview == NULL)
+    {
+        return NULL;
+    }
+
+    Py_buffer *view = PyMemoryView_GET_BUFFER(memoryview);
+    int channels = view->ndim == 3 ? (int)view->shape[2] : 1;
+    int itemSize = (int)view->itemsize;
+    if ((view->ndim != 2 && view->ndim != 3) ||
+        (channels != 1 && channels != 3 && channels != 4) ||
+        (itemSize != 1 && itemSize != 2))
+    {
+        Py_DECREF(memoryview);
+        PyErr_SetString(PyExc_ValueError, "image must be a uint8 or uint16 array of shape (height, width) or (height, width, 1|3|4)");
+        return NULL;
+    }
+
+    int height = (int)view->shape[0];
+    int width = (int)view->shape[1];
+    if (width == 0 || height == 0)
+    {
+        Py_DECREF(memoryview);
+        PyErr_SetString(PyExc_ValueError, "image is empty");
+        return NULL;
+    }
+
+    ptrdiff_t strides[3] = {view->strides[0], view->strides[1], view->ndim == 3 ? view->strides[2] : itemSize};
+    int rowBytes = width * channels * itemSize;
+
+    ImagePixelFormat format;
+    if (itemSize == 1)
+        format = channels == 1 ? IPF_GRAYSCALED : (channels == 3 ? IPF_RGB_888 : IPF_ARGB_8888);
+    else
+        format = channels == 4 ? IPF_ARGB_16161616 : IPF_RGB_161616;
+
+    bool packedPixels = strides[2] == itemSize && strides[1] == channels * itemSize && strides[0] >= rowBytes;
+    if (packedPixels && !(itemSize == 2 && channels == 1))
+    {
+        data->bytes = (unsigned char *)view->buf;
+        data->width = width;
+        data->height = height;
+        data->stride = (int)strides[0];
+        data->format = format;
+        data->bytesLength = (int)(strides[0] * (height - 1) + rowBytes);
+        return memoryview;
+    }
+
+    if (itemSize == 2 && channels == 1)
+    {
+        format = IPF_GRAYSCALED;
+        rowBytes = width;
+    }
+
+    PyObject *copy = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)rowBytes * height);
+    if (copy == NULL)
+    {
+        Py_DECREF(memoryview);
+        return NULL;
+    }
+
+    unsigned char *bytes = (unsigned char *)PyBytes_AS_STRING(copy);
+    if (itemSize == 2 && channels == 1)
+        gray16ToGray8(bytes, (const unsigned char *)view->buf, strides, width, height);
+    else
+        gatherImage(bytes, (const unsigned char *)view->buf, strides, width, height, channels, itemSize);
+    Py_DECREF(memoryview);
+
+    data->bytes = bytes;
+    data->width = width;
+    data->height = height;
+    data->stride = rowBytes;
+    data->format = format;
+    data->bytesLength = rowBytes * height;
+    return copy;
+}
+
+#endif
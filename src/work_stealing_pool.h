@@ -0,0 +1,322 @@
+#ifndef __WORK_STEALING_POOL_H__
+#define __WORK_STEALING_POOL_H__
+
+#include <Python.h>
+#include "DynamsoftLabelRecognizer.h"
+#include "recognition.h"
+#include "future_utils.h"
+#include <thread>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include <deque>
+#include <atomic>
+
+class PoolTask
+{
+public:
+    ImageData data;
+    DLR_ResultArray *results = NULL;
+    PyObject *owner = NULL;        // pins the image buffer
+    PyObject *future = NULL;       // completed by submit() tasks
+    class PoolBatch *batch = NULL; // counted down by mapImages() tasks
+};
+
+class PoolBatch
+{
+public:
+    std::mutex m;
+    std::condition_variable cv;
+    size_t remaining = 0;
+
+    void done()
+    {
+        std::lock_guard<std::mutex> lk(m);
+        if (--remaining == 0)
+            cv.notify_all();
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lk(m);
+        cv.wait(lk, [&]
+                { return remaining == 0; });
+    }
+};
+
+class PoolWorker
+{
+public:
+    void *handler;
+    std::mutex handlerLock;
+    std::mutex m;
+    std::deque<PoolTask *> tasks;
+    std::thread t;
+};
+
+/**
+ * N recognizer handles, each driven by its own native thread. Every worker
+ * owns a deque: it pops from the front of its own deque and, when that is
+ * empty, steals from the back of the others.
+ */
+class WorkStealingPool
+{
+public:
+    std::vector<PoolWorker *> workers;
+    std::mutex m;
+    std::condition_variable cv;
+    std::atomic<int> queued;
+    std::atomic<unsigned int> next;
+    std::atomic<bool> running;
+
+    void push(PoolTask *task)
+    {
+        PoolWorker *worker = workers[next++ % workers.size()];
+        {
+            std::lock_guard<std::mutex> lk(worker->m);
+            worker->tasks.push_back(task);
+        }
+        queued++;
+
+        // Take the lock so a worker checking the predicate cannot miss the notification.
+        std::lock_guard<std::mutex> lk(m);
+        cv.notify_one();
+    }
+
+    PoolTask *steal(size_t index)
+    {
+        size_t count = workers.size();
+        for (size_t i = 0; i < count; i++)
+        {
+            PoolWorker *worker = workers[(index + i) % count];
+            std::lock_guard<std::mutex> lk(worker->m);
+            if (worker->tasks.empty())
+                continue;
+
+            PoolTask *task;
+            if (i == 0)
+            {
+                task = worker->tasks.front();
+                worker->tasks.pop_front();
+            }
+            else
+            {
+                task = worker->tasks.back();
+                worker->tasks.pop_back();
+            }
+            queued--;
+            return task;
+        }
+
+        return NULL;
+    }
+
+    PoolTask *take(size_t index)
+    {
+        while (running)
+        {
+            PoolTask *task = steal(index);
+            if (task)
+                return task;
+
+            std::unique_lock<std::mutex> lk(m);
+            cv.wait(lk, [&]
+                    { return queued > 0 || !running; });
+        }
+
+        return NULL;
+    }
+
+    int loadSettings(const char *settings, char errorMsgBuffer[], int errorMsgBufferLen)
+    {
+        int ret = 0;
+        for (size_t i = 0; i < workers.size(); i++)
+        {
+            PoolWorker *worker = workers[i];
+            std::lock_guard<std::mutex> lk(worker->handlerLock);
+            ret = DLR_AppendSettingsFromString(worker->handler, settings, errorMsgBuffer, errorMsgBufferLen);
+            if (ret)
+                break;
+        }
+
+        return ret;
+    }
+};
+
+void completeFuture(PoolTask *task)
+{
+    PyGILState_STATE gstate;
+    gstate = PyGILState_Ensure();
+
+    PyObject *list = createPyResults(task->results);
+    if (list == NULL)
+        list = PyList_New(0);
+
+    resolveFuture(task->future, list);
+    Py_DECREF(list);
+    Py_DECREF(task->future);
+    Py_DECREF(task->owner);
+    delete task;
+
+    PyGILState_Release(gstate);
+}
+
+void runPoolWorker(WorkStealingPool *pool, size_t index)
+{
+    PoolWorker *worker = pool->workers[index];
+    while (PoolTask *task = pool->take(index))
+    {
+        {
+            std::lock_guard<std::mutex> lk(worker->handlerLock);
+            task->results = recognizeBuffer(worker->handler, &task->data);
+        }
+        if (task->future)
+        {
+            completeFuture(task);
+        }
+        else
+        {
+            task->batch->done();
+        }
+    }
+}
+
+/**
+ * Create a pool of recognizers and start their native threads.
+ *
+ * @param count number of recognizers, 0 for one per CPU core
+ */
+WorkStealingPool *createWorkStealingPool(int count)
+{
+    if (count <= 0)
+    {
+        count = std::thread::hardware_concurrency();
+        if (count <= 0)
+            count = 1;
+    }
+
+    WorkStealingPool *pool = new WorkStealingPool();
+    pool->queued = 0;
+    pool->next = 0;
+    pool->running = true;
+    for (int i = 0; i < count; i++)
+    {
+        PoolWorker *worker = new PoolWorker();
+        worker->handler = DLR_CreateInstance();
+        pool->workers.push_back(worker);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        pool->workers[i]->t = std::thread(&runPoolWorker, pool, (size_t)i);
+    }
+
+    return pool;
+}
+
+/**
+ * Stop the native threads, cancel queued futures and destroy the recognizers.
+ * Requires the GIL, and no mapImages() call may be using the pool.
+ */
+void destroyWorkStealingPool(WorkStealingPool *pool)
+{
+    {
+        std::lock_guard<std::mutex> lk(pool->m);
+        pool->running = false;
+        pool->cv.notify_all();
+    }
+
+    // Workers need the GIL to complete futures, so it must not be held while joining.
+    Py_BEGIN_ALLOW_THREADS
+    for (size_t i = 0; i < pool->workers.size(); i++)
+    {
+        pool->workers[i]->t.join();
+    }
+    Py_END_ALLOW_THREADS
+
+    for (size_t i = 0; i < pool->workers.size(); i++)
+    {
+        PoolWorker *worker = pool->workers[i];
+        // Batch tasks belong to the mapImages() call waiting for them, so only
+        // submit() tasks are released here.
+        for (size_t j = 0; j < worker->tasks.size(); j++)
+        {
+            PoolTask *task = worker->tasks[j];
+            if (task->future == NULL)
+                continue;
+            cancelFuture(task->future);
+            Py_DECREF(task->future);
+            Py_DECREF(task->owner);
+            delete task;
+        }
+
+        DLR_DestroyInstance(worker->handler);
+        delete worker;
+    }
+
+    delete pool;
+}
+
+/**
+ * Recognize a sequence of images across all recognizers of the pool with the
+ * GIL released.
+ *
+ * @param int format: RESULT_OBJECTS, RESULT_ARRAYS or RESULT_CHARACTERS
+ *
+ * @return a list holding the results of each image, in input order
+ */
+PyObject *mapImages(WorkStealingPool *pool, PyObject *seq, int format = RESULT_OBJECTS)
+{
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+    std::vector<PoolTask> tasks(count);
+    PoolBatch batch;
+    batch.remaining = count;
+
+    for (Py_ssize_t i = 0; i < count; i++)
+    {
+        tasks[i].owner = getImageData(PySequence_Fast_GET_ITEM(seq, i), &tasks[i].data);
+        if (tasks[i].owner == NULL)
+        {
+            for (Py_ssize_t j = 0; j < i; j++)
+                Py_DECREF(tasks[j].owner);
+            return NULL;
+        }
+        tasks[i].batch = &batch;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    for (Py_ssize_t i = 0; i < count; i++)
+    {
+        pool->push(&tasks[i]);
+    }
+    batch.wait();
+    Py_END_ALLOW_THREADS
+
+    PyObject *list = PyList_New(count);
+    for (Py_ssize_t i = 0; i < count; i++)
+    {
+        PyObject *results = createPyResults(tasks[i].results, format);
+        if (results == NULL)
+        {
+            if (PyErr_Occurred())
+            {
+                // Release the remaining results before bailing out.
+                for (Py_ssize_t j = i; j < count; j++)
+                {
+                    if (j > i && tasks[j].results)
+                        DLR_FreeResults(&tasks[j].results);
+                    Py_DECREF(tasks[j].owner);
+                }
+                Py_DECREF(list);
+                return NULL;
+            }
+            results = PyList_New(0);
+        }
+        PyList_SET_ITEM(list, i, results);
+        Py_DECREF(tasks[i].owner);
+    }
+
+    return list;
+}
+
+#endif
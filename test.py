@@ -1,50 +1,24 @@
 import cv2
+import threading
+import numpy as np
+from concurrent.futures import wait
 from time import sleep
 import mrzscanner
-from mrz.checker.td1 import TD1CodeChecker
-from mrz.checker.td2 import TD2CodeChecker
-from mrz.checker.td3 import TD3CodeChecker
-from mrz.checker.mrva import MRVACodeChecker
-from mrz.checker.mrvb import MRVBCodeChecker
 
 
 def check(lines):
-    try:
-        td1_check = TD1CodeChecker(lines)
-        if bool(td1_check):
-            return "TD1", td1_check.fields()
-    except Exception as err:
-        pass
-
-    try:
-        td2_check = TD2CodeChecker(lines)
-        if bool(td2_check):
-            return "TD2", td2_check.fields()
-    except Exception as err:
-        pass
-
-    try:
-        td3_check = TD3CodeChecker(lines)
-        if bool(td3_check):
-            return "TD3", td3_check.fields()
-    except Exception as err:
-        pass
-
-    try:
-        mrva_check = MRVACodeChecker(lines)
-        if bool(mrva_check):
-            return "MRVA", mrva_check.fields()
-    except Exception as err:
-        pass
-
-    try:
-        mrvb_check = MRVBCodeChecker(lines)
-        if bool(mrvb_check):
-            return "MRVB", mrvb_check.fields()
-    except Exception as err:
-        pass
-
-    return 'No valid MRZ information found'
+    document = mrzscanner.parse(lines)
+    if document is None or not document['valid']:
+        return 'No valid MRZ information found'
+
+    return document['type'], document
+
+
+def create_async_scanner(listener=lambda results: None):
+    reader = mrzscanner.createInstance()
+    reader.loadModel(mrzscanner.load_settings('MRZ.json'))
+    reader.addAsyncListener(listener)
+    return reader
 
 
 # set license
@@ -69,6 +43,18 @@ for result in results:
 print('')
 print(check(s[:-1]))
 
+# decodeBytes()
+print('')
+print('Test decodeBytes()')
+s = ""
+with open("images/1.png", "rb") as f:
+    results = scanner.decodeBytes(f.read())
+for result in results:
+    print(result.text)
+    s += result.text + '\n'
+print('')
+print(check(s[:-1]))
+
 # decodeMat()
 print('')
 print('Test decodeMat()')
@@ -101,3 +87,182 @@ image = cv2.imread("images/3.jpg")
 scanner.addAsyncListener(callback)
 scanner.decodeMatAsync(image)
 sleep(1)
+
+# ReaderPool
+print('')
+print('Test ReaderPool.map()')
+pool = mrzscanner.createReaderPool(2)
+pool.loadModel(mrzscanner.load_settings('MRZ.json'))
+for results in pool.map([cv2.imread("images/2.png"), cv2.imread("images/4.png")]):
+    s = ""
+    for result in results:
+        print(result.text)
+        s += result.text + '\n'
+    print('')
+    print(check(s[:-1]))
+
+# parse()
+print('')
+print('Test parse()')
+td3 = ['P<UTOERIKSSON<<ANNA<MARIA<<<<<<<<<<<<<<<<<<<',
+       'L898902C36UTO7408122F1204159ZE184226B<<<<<10']
+td1 = ['I<UTOD231458907<<<<<<<<<<<<<<<',
+       '7408122F1204159UTO<<<<<<<<<<<6',
+       'ERIKSSON<<ANNA<MARIA<<<<<<<<<<']
+
+document = mrzscanner.parse('\n'.join(td3))
+assert document['type'] == 'TD3' and document['valid'], document
+assert document['document_number'] == 'L898902C3', document
+assert document['birth_date'] == '740812', document
+
+document = mrzscanner.parse(td1)
+assert document['type'] == 'TD1' and document['valid'], document
+assert document['document_number'] == 'D23145890', document
+
+# a wrong check digit fails validation
+broken = [td3[0], td3[1].replace('7408122', '7408123')]
+document = mrzscanner.parse(broken)
+assert not document['valid'], document
+
+# a '<' read for a 0 check digit only passes for empty optional data
+born = [td3[0], 'L898902C36UTO7408100F1204159ZE184226B<<<<<10']
+assert mrzscanner.parse(born)['valid']
+filler = [td3[0], born[1][:19] + '<' + born[1][20:]]
+document = mrzscanner.parse(filler)
+assert not document['valid'] and not document['checks']['birth_date'], document
+
+# an O read for 0 in the birth date is repaired only with correct=True
+misread = [td3[0], td3[1][:15] + 'O' + td3[1][16:]]
+document = mrzscanner.parse(misread)
+assert not document['valid'], document
+document = mrzscanner.parse(misread, True)
+assert document['valid'] and document['corrections'] == 1, document
+assert document['lines'] == td3 and document['birth_date'] == '740812', document
+print('ok')
+
+# setAsyncQueue() and getAsyncStats()
+print('')
+print('Test setAsyncQueue()')
+frame = np.zeros((480, 640, 3), np.uint8)
+gate = threading.Event()
+reader = create_async_scanner(lambda results: gate.wait())
+reader.setAsyncQueue(1, mrzscanner.QUEUE_REJECT)
+reader.decodeMatAsync(frame).result()  # the worker now waits in the listener
+reader.decodeMatAsync(frame)
+try:
+    reader.decodeMatAsync(frame)
+    raise AssertionError('a full QUEUE_REJECT queue must raise')
+except RuntimeError:
+    pass
+stats = reader.getAsyncStats()
+assert stats['processed'] == 1 and stats['queued'] == 1 and stats['rejected'] == 1, stats
+gate.set()
+reader.clearAsyncListener()
+print('ok')
+
+# setFramePool()
+print('')
+print('Test setFramePool()')
+reader = create_async_scanner()
+reader.setFramePool(4)
+for _ in range(3):
+    reader.decodeMatAsync(frame).result()
+stats = reader.getAsyncStats()
+assert stats['pool_misses'] == 1 and stats['pool_hits'] == 2, stats
+reader.clearAsyncListener()
+print('ok')
+
+# futures of dropped frames
+print('')
+print('Test decodeMatAsync() futures')
+gate = threading.Event()
+reader = create_async_scanner(lambda results: gate.wait())
+reader.setAsyncQueue(1, mrzscanner.QUEUE_DROP_OLDEST)
+first = reader.decodeMatAsync(frame)
+assert isinstance(first.result(), list)
+dropped = reader.decodeMatAsync(frame)
+kept = reader.decodeMatAsync(frame)
+assert dropped.cancelled() and not kept.done()
+assert reader.getAsyncStats()['dropped_oldest'] == 1
+gate.set()
+assert isinstance(kept.result(), list)
+reader.clearAsyncListener()
+print('ok')
+
+# setConsensus()
+print('')
+print('Test setConsensus()')
+image = cv2.imread("images/2.png")
+reader = create_async_scanner()
+reader.setConsensus(2)
+for _ in range(4):
+    wait([reader.decodeMatAsync(image)])  # frames after the consensus are cancelled
+consensus = reader.getConsensus()
+assert consensus is not None and consensus['valid'], consensus
+reader.clearAsyncListener()
+print('ok')
+
+# setRoiTracking()
+print('')
+print('Test setRoiTracking()')
+reader = create_async_scanner()
+reader.setRoiTracking(True)
+full = reader.decodeMatAsync(image).result()
+tracked = reader.decodeMatAsync(image).result()  # recognized in the region of the first read
+assert reader.getAsyncStats()['roi_tracked'] == 1, reader.getAsyncStats()
+assert [result.text for result in tracked] == [result.text for result in full]
+reader.clearAsyncListener()
+print('ok')
+
+# sharpness() and setQualityGate()
+print('')
+print('Test setQualityGate()')
+sharp = ((np.indices((240, 320)).sum(axis=0) // 4) % 2 * 255).astype(np.uint8)
+blurred = cv2.GaussianBlur(sharp, (0, 0), 4)
+reader = create_async_scanner()
+assert reader.sharpness(sharp) > 10 * reader.sharpness(blurred)
+reader.setQualityGate(reader.sharpness(sharp) / 2)
+future = reader.decodeMatAsync(blurred)
+wait([future])
+assert future.cancelled() and reader.getAsyncStats()['blurry'] == 1
+reader.clearAsyncListener()
+print('ok')
+
+# setDeduplication()
+print('')
+print('Test setDeduplication()')
+reader = create_async_scanner()
+reader.setDeduplication(4)
+first = reader.decodeMatAsync(image).result()
+second = reader.decodeMatAsync(image).result()  # the same scene gets the cached results
+assert reader.getAsyncStats()['duplicates'] == 1
+assert [result.text for result in second] == [result.text for result in first]
+reader.clearAsyncListener()
+print('ok')
+
+# orientation()
+print('')
+print('Test orientation()')
+page = np.full((200, 900), 255, np.uint8)
+for i, line in enumerate(td3):
+    cv2.putText(page, line, (20, 80 + 60 * i), cv2.FONT_HERSHEY_SIMPLEX, 0.9, 0, 2)
+for k, angle in enumerate((0, 90, 180, 270)):
+    # np.rot90() turns counter-clockwise, so k turns need angle degrees clockwise
+    assert scanner.orientation(np.ascontiguousarray(np.rot90(page, k))) == angle
+print('ok')
+
+# setAsyncIngest()
+print('')
+print('Test setAsyncIngest()')
+results = scanner.decodeMat(image)
+xs = [x for result in results for x in (result.x1, result.x2, result.x3, result.x4)]
+ys = [y for result in results for y in (result.y1, result.y2, result.y3, result.y4)]
+x0, y0 = max(min(xs) - 20, 0), max(min(ys) - 20, 0)
+x1, y1 = min(max(xs) + 20, image.shape[1]), min(max(ys) + 20, image.shape[0])
+reader = create_async_scanner()
+reader.setAsyncIngest(1, (x0, y0, x1 - x0, y1 - y0))
+cropped = reader.decodeMatAsync(image).result()  # coordinates still refer to the whole image
+assert [result.text for result in cropped] == [result.text for result in results]
+assert all(abs(a.x1 - b.x1) <= 8 and abs(a.y1 - b.y1) <= 8 for a, b in zip(cropped, results))
+reader.clearAsyncListener()
+print('ok')